@@ -26,146 +26,333 @@
  * $FreeBSD$
  */
 
-#include <fstream>
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <vector>
 
 #include "add_testcase.h"
+#include "executor.h"
+#include "normalize.h"
+
+/*
+ * Initial capacity of a script, enough for the tests of most utilities to be
+ * built without reallocations.
+ */
+#define SCRIPT_RESERVE 16384
+/* Maximum number of lines (and bytes) checked of a truncated output. */
+#define TRUNCATED_LINES 8
+#define TRUNCATED_PREFIX 1024
+
+addtestcase::Script::Script()
+{
+	buffer.reserve(SCRIPT_RESERVE);
+}
+
+addtestcase::Script&
+addtestcase::Script::operator<<(std::string_view text)
+{
+	buffer.append(text);
+	return *this;
+}
+
+const std::string&
+addtestcase::Script::str() const
+{
+	return buffer;
+}
+
+/*
+ * Writes the script to "path" at once, atomically replacing the previous
+ * version. An identical script is not written again, so that its modification
+ * time is preserved.
+ */
+bool
+addtestcase::Script::Write(std::string path) const
+{
+	return utils::WriteFileIfChanged(path, buffer);
+}
+
+/* Appends the atf_check(1) output check for the expected "output". */
+static void
+ExpectedOutput(addtestcase::Script& script, std::string_view output)
+{
+	if (output.empty())
+		script << "empty ";
+	else
+		script << "inline:\"" << output << "\" ";
+}
+
+/*
+ * Appends the atf_check(1) checks (with "flag") for the expected "output" of a
+ * command, which is matched against regular expressions if it differs
+ * between the "repeated" executions of the command (see normalize.h).
+ */
+static void
+ExpectedOutput(addtestcase::Script& script,
+	       std::string_view flag,
+	       outputstore::Output output,
+	       const std::vector<outputstore::Output>& repeated)
+{
+	std::vector<std::string> patterns;
+
+	if (!normalize::Normalize(output, repeated, patterns)) {
+		script << flag << " ";
+		ExpectedOutput(script, output);
+	} else if (patterns.empty()) {
+		script << flag << " ignore ";
+	}
+	for (const auto &pattern : patterns) {
+		script << flag << " match:\"" << normalize::Quote(pattern)
+		       << "\" ";
+	}
+}
+
+/*
+ * Appends the atf_check(1) check for "command" whose output was truncated
+ * (see executor::max_output), i.e. which keeps producing output (e.g. yes(1))
+ * or does not exit after responding. Only a prefix of the output (its first
+ * few complete lines) is checked, and the utility is bounded by timeout(1)
+ * in case it stops producing output without exiting.
+ */
+static void
+TruncatedOutput(addtestcase::Script& script,
+		std::string command,
+		const utils::ProbeResult& output)
+{
+	std::string_view prefix = output.output.view().substr(0, TRUNCATED_PREFIX);
+	size_t pos = 0;
+
+	for (int i = 0; i < TRUNCATED_LINES; i++) {
+		size_t newline = prefix.find('\n', pos);
+
+		if (newline == std::string_view::npos)
+			break;
+		pos = newline + 1;
+	}
+	if (pos > 0)
+		prefix = prefix.substr(0, pos);
+	command = "timeout " + std::to_string(executor::max_time) + " "
+		+ command + " | head -c " + std::to_string(prefix.size());
+
+	script << "-o ";
+	/* The prefix is checked only if it is the same in every execution. */
+	if (std::all_of(output.repeated_output.begin(),
+			output.repeated_output.end(),
+			[prefix](const outputstore::Output& repeated) {
+				return repeated.view().substr(0, prefix.size())
+				       == prefix;
+			}))
+		ExpectedOutput(script, prefix);
+	else
+		script << "ignore ";
+	script << "-e ignore -x \"" << command << "\"";
+}
+
+/*
+ * Returns the name of a testcase (e.g. "l_flag") as a valid sh(1) function
+ * name, i.e. the '-' of a long option (e.g. "-version_flag") is replaced by
+ * '_', and a name starting with a digit (e.g. "0_flag") is prefixed by '_'.
+ * Annotations refer to the testcases by these names.
+ */
+std::string
+addtestcase::TestcaseName(std::string name)
+{
+	std::replace(name.begin(), name.end(), '-', '_');
+	if (!name.empty() && isdigit((unsigned char)name.front()))
+		name.insert(0, "_");
+	return name;
+}
 
 /* Adds a test-case for an option with known usage. */
 void
 addtestcase::KnownTestcase(std::string option,
 			   std::string util_with_section,
 			   std::string descr,
-			   std::string output,
-			   std::ofstream& test_script)
+			   const utils::ProbeResult& output,
+			   Script& test_script)
 {
 	std::string testcase_name;
 	std::string utility = util_with_section.substr(0,
 			      util_with_section.size() - 3);
+	std::string command = utility;
 
 	/* Add testcase name. */
-	test_script << "atf_test_case ";
 	if (!option.empty()) {
-		testcase_name = option;
-		testcase_name.append("_flag");
+		testcase_name = TestcaseName(option + "_flag");
 	} else {
 		testcase_name = "no_arguments";
 	}
-	test_script << testcase_name + "\n";
+	test_script << "atf_test_case " << testcase_name << "\n";
 
 	/* Add testcase description. */
-	test_script << testcase_name
-		     + "_head()\n{\n\tatf_set \"descr\" ";
-	if (!descr.empty()) {
+	test_script << testcase_name << "_head()\n{\n\tatf_set \"descr\" ";
+	if (!descr.empty())
 		test_script << descr;
-	}
-	else {
-		test_script << "\"Verify the usage of option \'"
-			     + option + "\'\"";
-	}
+	else
+		test_script << "\"Verify the usage of option \'" << option << "\'\"";
 	test_script << "\n}\n\n";
 
 	/* Add testcase body. */
-	test_script << testcase_name + "_body()\n{"
-		     + "\n\tatf_check -s exit:0 -o ";
-
-	if (!output.empty()) {
-		test_script << "inline:\"" + output + "\" ";
+	if (!option.empty())
+		command.append(" -" + option);
+	test_script << testcase_name << "_body()\n{\n\tatf_check -s exit:0 ";
+	if (output.truncated) {
+		TruncatedOutput(test_script, command, output);
 	} else {
-		test_script << "empty ";
+		ExpectedOutput(test_script, "-o", output.output,
+			       output.repeated_output);
+		/* The stderr is non-empty only if it was split from stdout. */
+		if (!output.error.empty())
+			ExpectedOutput(test_script, "-e", output.error,
+				       output.repeated_error);
+		test_script << command;
 	}
-	test_script << utility;
+	test_script << "\n}\n\n";
+}
 
-	if (!option.empty()) {
-		test_script << " -" + option;
+/*
+ * Adds a test-case for a combination of options which succeeded (see
+ * explore.h), named after the options, e.g. "a_b_flags" for "-a -b" (see
+ * TestcaseName()).
+ */
+void
+addtestcase::CombinationTestcase(const std::vector<std::string>& options,
+				 std::string util_with_section,
+				 const utils::ProbeResult& output,
+				 Script& test_script)
+{
+	std::string testcase_name;
+	std::string descr;
+	std::string arguments;
+	std::string utility = util_with_section.substr(0,
+			      util_with_section.size() - 3);
+
+	for (const auto &opt : options) {
+		testcase_name.append(opt + "_");
+		if (!descr.empty())
+			descr.append(opt == options.back() ? " and " : ", ");
+		descr.append("\'-" + opt + "\'");
+		arguments.append(" -" + opt);
 	}
-	test_script << "\n}\n\n";
+	testcase_name = TestcaseName(testcase_name + "flags");
+
+	test_script << "atf_test_case " << testcase_name << "\n"
+		    << testcase_name << "_head()\n{\n\tatf_set \"descr\" "
+		    << "\"Verify the usage of options " << descr << " together\""
+		    << "\n}\n\n"
+		    << testcase_name << "_body()\n{\n\tatf_check -s exit:0 ";
+	ExpectedOutput(test_script, "-o", output.output, output.repeated_output);
+	if (!output.error.empty())
+		ExpectedOutput(test_script, "-e", output.error, output.repeated_error);
+	test_script << utility << arguments << "\n}\n\n";
 }
 
 /* Adds a test-case for an option with unknown usage. */
 void
 addtestcase::UnknownTestcase(std::string option,
 			     std::string util_with_section,
-			     std::pair<std::string, int> output,
-			     std::string& testcase_buffer,
+			     const utils::ProbeResult& output,
+			     Script& testcase_buffer,
 			     bool usage_output)
 {
 	std::string utility = util_with_section.substr(0,
 			      util_with_section.size() - 3);
+	std::string_view message;  /* Output checked against the usage message. */
 
-	if (output.second) {
-		testcase_buffer.append("\n\tatf_check -s not-exit:0 -e ");
+	if (output.exitstatus) {
+		testcase_buffer << "\n\tatf_check -s not-exit:0 ";
+		if (utils::split_output) {
+			if (!output.output.empty()) {
+				testcase_buffer << "-o ";
+				ExpectedOutput(testcase_buffer, output.output);
+			}
+			message = output.error;
+		} else {
+			message = output.output;
+		}
+		testcase_buffer << "-e ";
 	} else {
-		testcase_buffer.append("\n\tatf_check -s exit:0 -o ");
+		testcase_buffer << "\n\tatf_check -s exit:0 -o ";
+		message = output.output;
 	}
 
 	/* Check if a usage message was produced (case-insensitive match). */
-	if (usage_output) {
-		testcase_buffer.append("match:\"$usage_output\" ");
-	} else if (!output.first.empty()) {
-		testcase_buffer.append("inline:\"" + output.first + "\" ");
-	} else {
-		testcase_buffer.append("empty ");
+	if (usage_output)
+		testcase_buffer << "match:\"$usage_output\" ";
+	else
+		ExpectedOutput(testcase_buffer, message);
+	if (!output.exitstatus && !output.error.empty()) {
+		testcase_buffer << "-e ";
+		ExpectedOutput(testcase_buffer, output.error);
 	}
 
-	testcase_buffer.append(utility);
-	if (!option.empty()) {
-		testcase_buffer.append(" -" + option);
-	}
+	testcase_buffer << utility;
+	if (!option.empty())
+		testcase_buffer << " -" << option;
 }
 
 /* Adds a test-case for usage without any arguments. */
 void
 addtestcase::NoArgsTestcase(std::string util_with_section,
-			    std::pair<std::string, int> output,
-			    std::ofstream& test_script,
+			    const utils::ProbeResult& output,
+			    Script& test_script,
 			    bool usage_output)
 {
 	std::string descr;
 	std::string utility = util_with_section.substr(0,
 			      util_with_section.size() - 3);
+	std::string_view message = output.output;
+	Script stdout_check;
+
+	/* With split streams, the diagnostics are expected on stderr. */
+	if (utils::split_output) {
+		message = output.error;
+		if (!output.output.empty()) {
+			stdout_check << "-o ";
+			ExpectedOutput(stdout_check, output.output);
+		}
+	}
 
-	if (output.second) {
+	if (output.exitstatus) {
 		/* An error was encountered. */
-		test_script << std::string("atf_test_case no_arguments\n")
-			     + "no_arguments_head()\n{\n\tatf_set \"descr\" ";
-		if (!output.first.empty()) {
+		test_script << "atf_test_case no_arguments\n"
+			       "no_arguments_head()\n{\n\tatf_set \"descr\" ";
+		if (!message.empty()) {
 			/*
 			 * We expect a usage message to be generated in this
 			 * case (case-insensitive match).
 			 */
 			if (usage_output) {
-				descr = "\"Verify that " + util_with_section
-				      + " fails and generates a valid usage \" "
-				      + "\\\n\t\t\t\"message when no arguments "
-				      + "are supplied\"";
-
-				test_script << descr
-					+ "\n}\n\nno_arguments_body()\n{"
-					+ "\n\tatf_check -s not-exit:0 -e match:"
-					+ "\"$usage_output\" " + utility;
+				test_script << "\"Verify that " << util_with_section
+					    << " fails and generates a valid usage \" "
+					       "\\\n\t\t\t\"message when no arguments "
+					       "are supplied\""
+					       "\n}\n\nno_arguments_body()\n{"
+					       "\n\tatf_check -s not-exit:0 "
+					    << stdout_check.str()
+					    << "-e match:\"$usage_output\" " << utility;
 			} else {
-				descr = "\"Verify that " + util_with_section
-				      + " fails and generates a valid output \" "
-				      + "\\\n\t\t\t\"when no arguments are supplied\"";
-
-				test_script << descr
-					+ "\n}\n\nno_arguments_body()\n{"
-					+ "\n\tatf_check -s not-exit:0 -e inline:"
-					+ "\"" + output.first + "\" "
-					+ utility;
+				test_script << "\"Verify that " << util_with_section
+					    << " fails and generates a valid output \" "
+					       "\\\n\t\t\t\"when no arguments are supplied\""
+					       "\n}\n\nno_arguments_body()\n{"
+					       "\n\tatf_check -s not-exit:0 "
+					    << stdout_check.str()
+					    << "-e inline:\"" << message << "\" "
+					    << utility;
 			}
 		} else {
-			descr = "\"Verify that " + util_with_section + " fails "
-			      + "silently when no arguments are supplied\"" ;
-			test_script << descr + "\n}\n\nno_arguments_body()\n{"
-				     + "\n\tatf_check -s not-exit:0 -e empty "
-				     + utility;
+			test_script << "\"Verify that " << util_with_section
+				    << " fails silently when no arguments are "
+				       "supplied\"\n}\n\nno_arguments_body()\n{"
+				       "\n\tatf_check -s not-exit:0 "
+				    << stdout_check.str() << "-e empty " << utility;
 		}
 		test_script << "\n}\n\n";
 	} else {
 		/* Successful execution implies the guessed usage is correct. */
-		if (!output.first.empty()) {
+		if (!output.output.empty()) {
 			descr = "\"Verify that " + util_with_section + " executes "
 			      + "successfully and produces a valid \" \\\n\t\t\t"
 			      + "\"output when invoked without any arguments\"";
@@ -175,6 +362,6 @@ addtestcase::NoArgsTestcase(std::string util_with_section,
 			      + "\t\t\t\"when invoked without any arguments\"";
 		}
 		addtestcase::KnownTestcase("", util_with_section, descr,
-					   output.first, test_script);
+					   output, test_script);
 	}
 }
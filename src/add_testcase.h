@@ -29,15 +29,41 @@
 #ifndef _ADD_TESTCASE_H_
 #define _ADD_TESTCASE_H_
 
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils.h"
+
 namespace addtestcase {
+	/*
+	 * A generated test script. It is built in memory and written out at
+	 * once, so that an interrupted run never leaves a partial script.
+	 */
+	class Script {
+	public:
+		Script();
+		Script& operator<<(std::string_view);
+		const std::string& str() const;
+		bool Write(std::string) const;
+
+	private:
+		std::string buffer;
+	};
+
+	std::string TestcaseName(std::string);
+
 	void KnownTestcase(std::string, std::string, std::string, \
-			   std::string, std::ofstream&);
+			   const utils::ProbeResult&, Script&);
+
+	void CombinationTestcase(const std::vector<std::string>&, std::string, \
+				 const utils::ProbeResult&, Script&);
 
-	void UnknownTestcase(std::string, std::string, std::pair<std::string, int>, \
-			     std::string&, bool);
+	void UnknownTestcase(std::string, std::string, const utils::ProbeResult&, \
+			     Script&, bool);
 
-	void NoArgsTestcase(std::string, std::pair<std::string, int>, \
-			    std::ofstream&, bool);
+	void NoArgsTestcase(std::string, const utils::ProbeResult&, \
+			    Script&, bool);
 }
 
 #endif  /* _ADD_TESTCASE_H_ */
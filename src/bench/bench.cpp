@@ -0,0 +1,312 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Micro-benchmarks for the hot paths of the test generator. Each stage is
+ * timed on fixed inputs: a synthetic man page, a stub utility which exits
+ * instantly and one which hangs.
+ */
+
+#include <sys/stat.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../add_testcase.h"
+#include "../executor.h"
+#include "../fetch_groff.h"
+#include "../mdoc.h"
+#include "../utils.h"
+
+/* Minimum time (milliseconds) every benchmark runs for. */
+#define MIN_TIME 500
+/* Number of options documented in the synthetic man page. */
+#define PAGE_OPTIONS 200
+/* Number of commands kept in flight by the concurrent executor benchmark. */
+#define PROBES 16
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+	std::string name;
+	double ns_per_op;
+	double allocs_per_op;
+	double ops_per_sec;
+};
+
+static std::atomic<unsigned long> allocations(0);
+
+void *
+operator new(size_t size)
+{
+	void *ptr;
+
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if ((ptr = malloc(size ? size : 1)) == NULL)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+static long min_time = MIN_TIME;
+
+/*
+ * Runs "fn" (performing "ops" operations per call) repeatedly for at least
+ * "min_time" milliseconds, and returns the per-operation averages.
+ */
+template <typename Fn>
+static Result
+Measure(std::string name, Fn fn, int ops = 1)
+{
+	Result result;
+	Clock::time_point start;
+	double elapsed;
+	unsigned long allocs;
+	long calls = 0;
+
+	fn();  /* Warm up the caches. */
+
+	allocs = allocations.load();
+	start = Clock::now();
+	do {
+		fn();
+		calls++;
+		elapsed = std::chrono::duration<double, std::nano>
+			(Clock::now() - start).count();
+	} while (elapsed < min_time * 1e6);
+	allocs = allocations.load() - allocs;
+
+	result.name = name;
+	result.ns_per_op = elapsed / (calls * ops);
+	result.allocs_per_op = (double)allocs / (calls * ops);
+	result.ops_per_sec = 1e9 / result.ns_per_op;
+	return result;
+}
+
+/* Writes the synthetic man page documenting PAGE_OPTIONS options. */
+static void
+WritePage(std::string path)
+{
+	std::ofstream page(path);
+
+	page << ".Dd January 1, 2018\n.Dt BENCH 1\n.Os\n"
+		".Sh NAME\n.Nm bench\n.Nd synthetic utility\n"
+		".Sh SYNOPSIS\n.Nm\n.Op Fl abcdefgh\n.Op Fl o Ar file\n"
+		".Sh DESCRIPTION\n.Bl -tag -width Ds\n";
+	for (int i = 0; i < PAGE_OPTIONS; i++) {
+		page << ".It Fl opt" << i << (i % 3 ? "" : " Ar value") << "\n"
+			"Enable the behaviour number " << i << " of the utility,\n"
+			"which is described over a few lines of text such as\n"
+			".Pa /etc/bench.conf .\n";
+		if (i % 10 == 0) {
+			page << ".Bl -tag -width indent\n.It Cm first\n"
+				"Nested item.\n.It Cm second\nNested item.\n.El\n";
+		}
+	}
+	page << ".It Fl h\nPrint a help message.\n"
+		".It Fl Fl version\nPrint the version.\n.El\n"
+		".Sh SEE ALSO\n.Xr true 1\n";
+}
+
+/* Writes an executable shell script at "path". */
+static void
+WriteStub(std::string path, std::string body)
+{
+	std::ofstream stub(path);
+
+	stub << "#!/bin/sh\n" << body << "\n";
+	stub.close();
+	chmod(path.c_str(), 0755);
+}
+
+/* Loads the ns/op recorded in "path" by a previous run. */
+static std::unordered_map<std::string, double>
+LoadBaseline(std::string path)
+{
+	std::unordered_map<std::string, double> baseline;
+	std::ifstream file(path);
+	std::string name;
+	std::string line;
+	double ns;
+
+	while (std::getline(file, line)) {
+		char buf[64];
+		if (sscanf(line.c_str(), "%63s %lf", buf, &ns) == 2) {
+			name = buf;
+			baseline[name] = ns;
+		}
+	}
+
+	return baseline;
+}
+
+static void
+Usage()
+{
+	std::cerr << "Usage: bench [-b <baseline>] [-o <output>] [-t <msec>]\n";
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	std::vector<Result> results;
+	std::unordered_map<std::string, double> baseline;
+	std::string baseline_file;
+	std::string output_file;
+	std::string workdir;
+	std::string page;
+	std::string true_stub;
+	std::string hang_stub;
+	char dirname[] = "/tmp/bench.XXXXXX";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:o:t:")) != -1) {
+		switch (opt) {
+		case 'b':
+			baseline_file = optarg;
+			break;
+		case 'o':
+			output_file = optarg;
+			break;
+		case 't':
+			if ((min_time = atol(optarg)) <= 0)
+				Usage();
+			break;
+		default:
+			Usage();
+		}
+	}
+
+	if (mkdtemp(dirname) == NULL) {
+		perror("mkdtemp()");
+		return EXIT_FAILURE;
+	}
+	workdir = dirname;
+	page = workdir + "/bench.1";
+	true_stub = workdir + "/true_stub";
+	hang_stub = workdir + "/hang_stub";
+	WritePage(page);
+	WriteStub(true_stub, "exit 0");
+	WriteStub(hang_stub, "exec sleep 3600");
+	groff::groff_map["bench"] = page;
+	boost::filesystem::create_directory(utils::tmpdir);
+
+	/* Man page parsing. */
+	results.push_back(Measure("mdoc_parse", [&] {
+		mdoc::Page parsed;
+		parsed.Open(page);
+	}));
+	results.push_back(Measure("check_opts", [&] {
+		utils::OptDefinition opt_def;
+		opt_def.CheckOpts("bench");
+	}));
+
+	/* Testcase emission. */
+	utils::ProbeResult output;
+	output.output = outputstore::Output("usage: bench [-abcdefgh] [-o file]");
+	output.exitstatus = 1;
+	output.timedout = false;
+	output.latency = 0;
+	results.push_back(Measure("emit_testcases", [&] {
+		addtestcase::Script script;
+		addtestcase::Script buffer;
+		for (int i = 0; i < 100; i++) {
+			addtestcase::KnownTestcase("a", "bench(1)", "", output,
+						   script);
+			addtestcase::UnknownTestcase("b", "bench(1)", output,
+						     buffer, true);
+		}
+		addtestcase::NoArgsTestcase("bench(1)", output, script, true);
+	}, 201));
+
+	/* Command execution, serially and concurrently. */
+	results.push_back(Measure("execute_true", [&] {
+		utils::Execute(utils::GenerateCommand(true_stub, ""));
+	}));
+	results.push_back(Measure("executor_true", [&] {
+		executor::Executor executor(PROBES);
+		for (int i = 0; i < 4 * PROBES; i++)
+			executor.Submit(utils::GenerateCommand(true_stub, ""),
+					[](const utils::ProbeResult&) {});
+		executor.Run();
+	}, 4 * PROBES));
+	results.push_back(Measure("execute_hang", [&] {
+		utils::Execute(utils::GenerateCommand(hang_stub, ""));
+	}));
+
+	if (!baseline_file.empty())
+		baseline = LoadBaseline(baseline_file);
+
+	printf("%-16s %14s %12s %12s %9s\n", "benchmark", "ns/op",
+	       "allocs/op", "ops/sec", "baseline");
+	for (const auto &r : results) {
+		printf("%-16s %14.0f %12.2f %12.1f", r.name.c_str(),
+		       r.ns_per_op, r.allocs_per_op, r.ops_per_sec);
+		auto it = baseline.find(r.name);
+		if (it != baseline.end() && it->second > 0)
+			printf(" %+8.1f%%", 100 * (r.ns_per_op - it->second)
+					      / it->second);
+		printf("\n");
+	}
+
+	if (!output_file.empty()) {
+		std::ofstream file(output_file);
+		for (const auto &r : results)
+			file << r.name << " " << r.ns_per_op << " "
+			     << r.allocs_per_op << "\n";
+		if (!file)
+			std::cerr << "Unable to write: " << output_file << "\n";
+	}
+
+	boost::filesystem::remove_all(utils::tmpdir);
+	boost::filesystem::remove_all(workdir);
+	return EXIT_SUCCESS;
+}
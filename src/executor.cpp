@@ -0,0 +1,409 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "executor.h"
+#include "logging.h"
+#include "sandbox.h"
+#include "trace.h"
+#include "utils.h"
+
+/*
+ * Buffer size (used for buffering output generated after executing the
+ * utility-specific command). A pipe is drained via read(2)s of this size,
+ * hence most commands need a single read.
+ */
+#define BUFSIZE 65536
+#define TIMEOUT 1  /* Threshold (seconds) for a command to respond. */
+/*
+ * Interval (milliseconds) for checking the status of the commands which closed
+ * their pipes, where their exit cannot be waited for (see Reap()).
+ */
+#define REAP_INTERVAL 1
+/*
+ * Time (milliseconds) after which, and the interval at which, a command
+ * which has not responded is checked for being blocked on a read.
+ */
+#define CHECK_GRACE 20
+#define CHECK_INTERVAL 20
+/* Time (milliseconds) a killed command is given to exit on SIGTERM. */
+#define KILL_GRACE 100
+
+int executor::max_probes = 4;
+const long executor::default_timeout = TIMEOUT * 1000;
+long executor::max_time = 10;
+size_t executor::max_output = 1UL << 20;
+
+executor::Executor::Executor(int max_inflight, Mode mode)
+	: max_inflight(max_inflight < 1 ? 1 : max_inflight), mode(mode)
+{
+}
+
+/*
+ * Queues "command" for execution. "callback" is invoked from Run() once the
+ * command completes. The command is given "timeout" milliseconds (TIMEOUT
+ * seconds if zero) to respond, or in TEST mode, to complete.
+ */
+void
+executor::Executor::Submit(std::string command, Callback callback, long timeout)
+{
+	queue.push_back({ command, callback, timeout });
+}
+
+void
+executor::Executor::Start(const Request& request)
+{
+	utils::PipeDescriptor *pipe_descr;
+	Probe probe;
+
+	probe.sandbox = sandbox::Acquire();
+	if ((pipe_descr = utils::Spawn(request.command,
+				       probe.sandbox.c_str())) == NULL) {
+		logging::LogPerror("utils::Spawn()");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Close the unrequired file-descriptor. */
+	close(pipe_descr->writefd);
+	probe.command = request.command;
+	probe.callback = request.callback;
+	probe.pid = pipe_descr->pid;
+	probe.readfd = pipe_descr->readfd;
+	probe.errfd = pipe_descr->errfd;
+	probe.exitfd = -1;
+	fcntl(probe.readfd, F_SETFL, O_NONBLOCK);
+	if (probe.errfd >= 0)
+		fcntl(probe.errfd, F_SETFL, O_NONBLOCK);
+	probe.result.exitstatus = 0;
+	probe.result.timedout = false;
+	probe.result.truncated = false;
+	probe.result.latency = 0;
+	probe.start = Clock::now();
+	if (request.timeout > 0)
+		probe.deadline = probe.start
+			       + std::chrono::milliseconds(request.timeout);
+	else
+		probe.deadline = probe.start + std::chrono::seconds(TIMEOUT);
+	probe.next_check = probe.start + std::chrono::milliseconds(CHECK_GRACE);
+	probe.expiry = probe.start + std::chrono::seconds(max_time);
+	probe.escalation = Clock::time_point::max();
+	probe.responded = false;
+	free(pipe_descr);
+
+	running.push_back(std::move(probe));
+}
+
+/*
+ * Drains the pipe "fd" of a command into "output", closing the pipe once
+ * the end of output is reached. A command which produces more than
+ * "max_output" bytes (e.g. yes(1)) is killed, retaining only the first
+ * "max_output" bytes.
+ */
+void
+executor::Executor::ReadOutput(Probe& probe, int& fd, std::string& output)
+{
+	static thread_local char buffer[BUFSIZE];
+	ssize_t len;
+
+	if (!probe.responded) {
+		probe.responded = true;
+		probe.result.latency = std::chrono::duration_cast
+			<std::chrono::milliseconds>(Clock::now() - probe.start).count();
+	}
+
+	for (;;) {
+		if ((len = read(fd, buffer, BUFSIZE)) > 0) {
+			size_t captured = probe.output.size() + probe.error.size();
+
+			if (captured + len > max_output) {
+				output.append(buffer, max_output - captured);
+				Kill(probe, probe.result.truncated);
+				return;
+			}
+			output.append(buffer, len);
+			continue;
+		}
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		/* End of output. */
+		close(fd);
+		fd = -1;
+		return;
+	}
+}
+
+/*
+ * Terminates a command which did not respond (or complete) in time, along
+ * with the processes it started, recording why in "reason". Since a few of
+ * the utilities performing blocking reads don't respond to SIGINT (e.g.
+ * pax(1)), the processes are terminated via SIGTERM, and via SIGKILL if
+ * they are still running after KILL_GRACE milliseconds (see Run()).
+ */
+void
+executor::Executor::Kill(Probe& probe, bool& reason)
+{
+	/* The command leads a process group of its own, see POpen(). */
+	if (killpg(probe.pid, SIGTERM) < 0 && errno != ESRCH)
+		logging::LogPerror("killpg()");
+	reason = true;
+	probe.escalation = Clock::now() + std::chrono::milliseconds(KILL_GRACE);
+	if (probe.readfd >= 0) {
+		close(probe.readfd);
+		probe.readfd = -1;
+	}
+	if (probe.errfd >= 0) {
+		close(probe.errfd);
+		probe.errfd = -1;
+	}
+}
+
+/*
+ * Collects the exit status of a command which closed its output pipe (or
+ * was killed), and kills the processes it left behind (e.g. started in the
+ * background). A command terminated by a signal (e.g. SIGXCPU, see
+ * utils::probe_limits, or the one sent when it timed out) exits with 128
+ * plus the signal number, as in sh(1), unless it was killed only for its
+ * output being truncated. Returns false if the command has not exited yet,
+ * in which case Run() waits on its "exitfd" (if supported) for it to exit.
+ */
+bool
+executor::Executor::Reap(Probe& probe)
+{
+	int pstat;
+	pid_t pid;
+
+	do {
+		pid = wait4(probe.pid, &pstat, WNOHANG, &probe.rusage);
+	} while (pid == -1 && errno == EINTR);
+
+	if (pid == 0) {
+		if (probe.exitfd < 0)
+			probe.exitfd = utils::ExitDescriptor(probe.pid);
+		return false;
+	}
+	if (probe.exitfd >= 0)
+		close(probe.exitfd);
+
+	if (pid == -1) {
+		probe.result.exitstatus = -1;
+		memset(&probe.rusage, 0, sizeof(probe.rusage));
+	} else if (WIFSIGNALED(pstat) && !probe.result.truncated) {
+		probe.result.exitstatus = 128 + WTERMSIG(pstat);
+	} else {
+		probe.result.exitstatus = WEXITSTATUS(pstat);
+	}
+	/* The process group outlives its leader while it has members. */
+	killpg(probe.pid, SIGKILL);
+	DEBUGP("Command: %s, exit status: %d\n", probe.command.c_str(),
+	       probe.result.exitstatus);
+	return true;
+}
+
+/* Records the execution of a (reaped) command in the trace. */
+void
+executor::Executor::Trace(const Probe& probe)
+{
+	const struct rusage& ru = probe.rusage;
+	trace::Args args;
+
+	args.push_back({ "exit", std::to_string(probe.result.exitstatus) });
+	args.push_back({ "timedout", probe.result.timedout ? "true" : "false" });
+	args.push_back({ "truncated", probe.result.truncated ? "true" : "false" });
+	args.push_back({ "latency_ms", std::to_string(probe.result.latency) });
+	args.push_back({ "user_us", std::to_string((long)ru.ru_utime.tv_sec
+						  * 1000000 + ru.ru_utime.tv_usec) });
+	args.push_back({ "sys_us", std::to_string((long)ru.ru_stime.tv_sec
+						 * 1000000 + ru.ru_stime.tv_usec) });
+	args.push_back({ "maxrss_kb", std::to_string(ru.ru_maxrss) });
+	args.push_back({ "output_bytes", std::to_string(probe.output.size()
+							+ probe.error.size()) });
+	trace::Async(probe.command, "probe", probe.start, Clock::now(), args);
+}
+
+/* Executes the queued commands, returning once all of them have completed. */
+void
+executor::Executor::Run()
+{
+	std::vector<struct pollfd> pollfds;
+	std::vector<size_t> polled;  /* Index in "running" of each pollfd. */
+	std::vector<bool> polled_err;  /* Whether the pollfd is for stderr. */
+	std::vector<Probe> completed;
+	Clock::time_point now;
+	Clock::time_point wakeup;
+	long timeout;
+
+	while (!queue.empty() || !running.empty()) {
+		while (running.size() < (size_t)max_inflight && !queue.empty()) {
+			Start(queue.front());
+			queue.pop_front();
+		}
+
+		/*
+		 * Wait until either a pipe becomes readable, a command which
+		 * closed its pipes exits, or the earliest deadline (or check
+		 * for a blocked read, or escalation of a kill) is due.
+		 */
+		pollfds.clear();
+		polled.clear();
+		polled_err.clear();
+		now = Clock::now();
+		wakeup = Clock::time_point::max();
+		for (size_t i = 0; i < running.size(); i++) {
+			Probe& probe = running[i];
+
+			if (probe.readfd < 0 && probe.errfd < 0 &&
+			    probe.exitfd >= 0) {
+				pollfds.push_back({ probe.exitfd, POLLIN, 0 });
+				polled.push_back(i);
+				polled_err.push_back(false);
+			} else if (probe.readfd < 0 && probe.errfd < 0) {
+				wakeup = std::min(wakeup, now +
+					std::chrono::milliseconds(REAP_INTERVAL));
+			}
+			if (probe.readfd >= 0) {
+				pollfds.push_back({ probe.readfd, POLLIN, 0 });
+				polled.push_back(i);
+				polled_err.push_back(false);
+			}
+			if (probe.errfd >= 0) {
+				pollfds.push_back({ probe.errfd, POLLIN, 0 });
+				polled.push_back(i);
+				polled_err.push_back(true);
+			}
+			if (probe.result.timedout || probe.result.truncated) {
+				wakeup = std::min(wakeup, probe.escalation);
+			} else if (mode == TEST) {
+				wakeup = std::min(wakeup, probe.deadline);
+			} else if (!probe.responded) {
+				wakeup = std::min(wakeup,
+					std::min(probe.deadline, probe.next_check));
+			} else {
+				wakeup = std::min(wakeup, probe.expiry);
+			}
+		}
+		if (wakeup == Clock::time_point::max()) {
+			timeout = -1;
+		} else {
+			timeout = std::chrono::duration_cast
+				<std::chrono::milliseconds>(wakeup - now).count() + 1;
+			timeout = std::max(timeout, 0L);
+		}
+
+		if (poll(pollfds.data(), pollfds.size(), timeout) < 0 &&
+		    errno != EINTR) {
+			logging::LogPerror("poll()");
+			exit(EXIT_FAILURE);
+		}
+
+		for (size_t i = 0; i < pollfds.size(); i++) {
+			Probe& probe = running[polled[i]];
+
+			if (!(pollfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (pollfds[i].fd == probe.exitfd)
+				continue;  /* Reaped below. */
+			if (polled_err[i])
+				ReadOutput(probe, probe.errfd, probe.error);
+			else
+				ReadOutput(probe, probe.readfd, probe.output);
+		}
+
+		/*
+		 * A command which has not responded by its deadline (most
+		 * probably) is stuck on a blocking read waiting for the user
+		 * input. There is no point in waiting for the deadline if the
+		 * command is already known to be blocked on a read. A command
+		 * which responded but keeps running past "max_time" (e.g. it
+		 * streams its output slowly) is killed with its output
+		 * truncated.
+		 */
+		now = Clock::now();
+		for (auto &probe : running) {
+			if (probe.result.timedout || probe.result.truncated) {
+				/* Killed, but did not exit on SIGTERM. */
+				if (now >= probe.escalation) {
+					killpg(probe.pid, SIGKILL);
+					probe.escalation = Clock::time_point::max();
+				}
+				continue;
+			}
+			if (mode == TEST) {
+				if (now >= probe.deadline)
+					Kill(probe, probe.result.timedout);
+				continue;
+			}
+			if (probe.responded) {
+				if (now >= probe.expiry)
+					Kill(probe, probe.result.truncated);
+				continue;
+			}
+			if (now >= probe.deadline) {
+				Kill(probe, probe.result.timedout);
+			} else if (now >= probe.next_check) {
+				if (utils::BlockedOnRead(probe.pid))
+					Kill(probe, probe.result.timedout);
+				probe.next_check = now +
+					std::chrono::milliseconds(CHECK_INTERVAL);
+			}
+		}
+
+		/*
+		 * Deliver the results of the completed commands. Callbacks may
+		 * submit further commands, hence the completed ones are
+		 * removed from "running" before invoking them.
+		 */
+		completed.clear();
+		for (size_t i = 0; i < running.size(); ) {
+			if (running[i].readfd < 0 && running[i].errfd < 0 &&
+			    Reap(running[i])) {
+				completed.push_back(std::move(running[i]));
+				running.erase(running.begin() + i);
+			} else {
+				i++;
+			}
+		}
+		for (auto &probe : completed) {
+			sandbox::Release(probe.sandbox);
+			if (!trace::tracefile.empty())
+				Trace(probe);
+			probe.result.output = outputstore::Output(probe.output);
+			probe.result.error = outputstore::Output(probe.error);
+			probe.callback(probe.result);
+		}
+	}
+}
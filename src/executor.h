@@ -0,0 +1,119 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+namespace executor {
+	/* Maximum number of commands an executor keeps in flight. */
+	extern int max_probes;
+	/* Milliseconds a command is given to respond by default. */
+	extern const long default_timeout;
+	/*
+	 * Seconds a command is given to complete once it has responded, and
+	 * the number of bytes of its output which are captured (see
+	 * ProbeResult::truncated).
+	 */
+	extern long max_time;
+	extern size_t max_output;
+
+	/* Invoked with the result of a completed command. */
+	typedef std::function<void(const utils::ProbeResult&)> Callback;
+
+	/* How the timeout of a command is applied. */
+	enum Mode {
+		PROBE,  /* To respond, a command blocked on a read is killed. */
+		TEST,   /* To complete, e.g. for running the generated tests. */
+	};
+
+	/*
+	 * Executes multiple commands concurrently from a single thread. The
+	 * output pipes of all the running commands are multiplexed in one
+	 * poll(2) loop, and each command has its own deadline.
+	 */
+	class Executor {
+	public:
+		Executor(int = max_probes, Mode = PROBE);
+
+		void Submit(std::string, Callback, long = 0);
+		void Run();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct Request {
+			std::string command;
+			Callback callback;
+			long timeout;  /* Milliseconds, 0 for the default. */
+		};
+
+		struct Probe {
+			std::string command;
+			Callback callback;
+			std::string sandbox;   /* Directory it is executed in. */
+			pid_t pid;
+			int readfd;            /* -1 once the pipe is closed. */
+			int errfd;             /* Likewise, for stderr. */
+			int exitfd;            /* See Reap(), or -1. */
+			std::string output;    /* Read so far, see ReadOutput(). */
+			std::string error;
+			utils::ProbeResult result;
+			Clock::time_point start;
+			Clock::time_point deadline;
+			Clock::time_point next_check;  /* See BlockedOnRead(). */
+			Clock::time_point expiry;      /* See "max_time". */
+			Clock::time_point escalation;  /* See Kill(). */
+			bool responded;        /* Pipe became readable. */
+			struct rusage rusage;  /* Resources used, once reaped. */
+		};
+
+		int max_inflight;
+		Mode mode;
+		std::deque<Request> queue;
+		std::vector<Probe> running;
+
+		void Start(const Request&);
+		void ReadOutput(Probe&, int&, std::string&);
+		void Kill(Probe&, bool&);
+		bool Reap(Probe&);
+		void Trace(const Probe&);
+	};
+}
+
+#endif  /* _EXECUTOR_H_ */
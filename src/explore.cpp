@@ -0,0 +1,194 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+#include "add_testcase.h"
+#include "explore.h"
+#include "read_annotations.h"
+
+/* Maximum number of options in a combination. */
+#define MAX_COMBINATION 3
+
+long explore::budget = 0;
+
+/* Map a utility to its quota of the budget, see Init(). */
+static std::unordered_map<std::string, long> quotas;
+
+/*
+ * Divides the budget among "utilities" (sorted, before being split between
+ * the shards) in equal quotas, the first ones getting one more combination
+ * each if the budget does not divide evenly. The quotas are fixed before any
+ * utility is explored, so that the explored combinations depend neither on
+ * the order in which the workers explore the utilities nor on the sharding.
+ */
+void
+explore::Init(const std::vector<std::string>& utilities)
+{
+	long count = utilities.size();
+
+	quotas.clear();
+	for (long i = 0; i < count; i++)
+		quotas[utilities[i]] = budget / count + (i < budget % count);
+}
+
+/* Joins the "options" via "separator". */
+std::string
+explore::Join(const std::vector<std::string>& options,
+	      std::string_view separator)
+{
+	std::string joined;
+
+	for (const auto &opt : options) {
+		if (!joined.empty())
+			joined.append(separator);
+		joined.append(opt);
+	}
+	return joined;
+}
+
+/*
+ * Returns whether the options "a" and "b" are mutually exclusive, i.e. they
+ * belong to the same group, or to disjoint forms of the synopsis.
+ */
+static bool
+Exclusive(const utils::OptDefinition& opt_def,
+	  const std::string& a,
+	  const std::string& b)
+{
+	auto x = opt_def.opt_synopsis.find(a);
+	auto y = opt_def.opt_synopsis.find(b);
+
+	if (x == opt_def.opt_synopsis.end() || y == opt_def.opt_synopsis.end())
+		return false;
+	if (x->second.first != 0 && x->second.first == y->second.first)
+		return true;
+	return x->second.second != 0 && y->second.second != 0 &&
+	       (x->second.second & y->second.second) == 0;
+}
+
+/*
+ * Executes (via "plan") the combinations of the options of "utility" whose
+ * usage is unknown, and returns the ones which succeeded. The options which
+ * failed (or did not complete) on their own, or require an argument, are
+ * left out.
+ */
+std::vector<std::vector<std::string>>
+explore::Explore(std::string utility,
+		 const utils::OptDefinition& opt_def,
+		 probeplan::ProbePlan& plan)
+{
+	std::vector<std::vector<std::string>> combinations;
+	std::vector<std::vector<std::string>> candidates;
+	std::vector<std::string> options;
+	std::unordered_map<std::string, size_t> position;
+	std::set<std::vector<std::string>> succeeded;
+	auto quota = quotas.find(utility);
+	long remaining;  /* Combinations of the quota yet to be executed. */
+
+	if (quota == quotas.end() || quota->second <= 0)
+		return combinations;
+	remaining = quota->second;
+
+	for (const auto &opt : opt_def.opt_list) {
+		const utils::ProbeResult& result = plan.Result(opt);
+		auto arg = opt_def.opt_args.find(opt);
+
+		if (result.exitstatus || result.timedout || result.truncated ||
+		    (arg != opt_def.opt_args.end() &&
+		     arg->second == mdoc::ARG_REQUIRED))
+			continue;
+		position[opt] = options.size();
+		options.push_back(opt);
+	}
+	for (size_t i = 0; i < options.size(); i++) {
+		for (size_t j = i + 1; j < options.size(); j++) {
+			if (!Exclusive(opt_def, options[i], options[j]))
+				candidates.push_back({ options[i], options[j] });
+		}
+	}
+
+	for (size_t size = 2; !candidates.empty(); size++) {
+		candidates.erase(std::remove_if(candidates.begin(),
+						candidates.end(),
+			[&utility](const std::vector<std::string>& c) {
+				return annotations::Annotated(utility,
+					addtestcase::TestcaseName(Join(c, "_")
+								  + "_flags"));
+			}), candidates.end());
+		candidates.resize(std::min((long)candidates.size(), remaining));
+		remaining -= candidates.size();
+		for (const auto &c : candidates)
+			plan.Add(Join(c, " -"));
+		plan.Run();
+
+		succeeded.clear();
+		for (const auto &c : candidates) {
+			const utils::ProbeResult& result = plan.Result(Join(c, " -"));
+
+			if (result.exitstatus == 0 && !result.timedout &&
+			    !result.truncated) {
+				combinations.push_back(c);
+				succeeded.insert(c);
+			}
+		}
+		if (size == MAX_COMBINATION)
+			break;
+
+		/*
+		 * Extend the combinations which succeeded by a following
+		 * option, provided that every combination it contains
+		 * succeeded as well.
+		 */
+		std::vector<std::vector<std::string>> extensible;
+		for (const auto &c : candidates) {
+			if (succeeded.count(c))
+				extensible.push_back(c);
+		}
+		candidates.clear();
+		for (const auto &c : extensible) {
+			for (size_t k = position[c.back()] + 1; k < options.size(); k++) {
+				std::vector<std::string> extended = c;
+				bool viable = true;
+
+				extended.push_back(options[k]);
+				for (size_t drop = 0; viable && drop < c.size(); drop++) {
+					std::vector<std::string> sub = extended;
+					sub.erase(sub.begin() + drop);
+					viable = succeeded.count(sub) != 0;
+				}
+				if (viable)
+					candidates.push_back(extended);
+			}
+		}
+	}
+
+	return combinations;
+}
@@ -0,0 +1,57 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _EXPLORE_H_
+#define _EXPLORE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "probe_plan.h"
+#include "utils.h"
+
+/*
+ * Exploration of the combinations of options. The options which succeed
+ * on their own are combined in pairs, and the pairs which succeed are
+ * extended (one option at a time) into combinations of up to three options.
+ * A combination is not executed if its options are mutually exclusive as per
+ * the synopsis, or if any of its sub-combinations failed. The number of
+ * executed combinations is bounded by a budget divided among all the
+ * utilities in fixed quotas (see Init()).
+ */
+namespace explore {
+	extern long budget;  /* Number of combinations, 0 disables. */
+
+	void Init(const std::vector<std::string>&);
+	std::vector<std::vector<std::string>> Explore(std::string,
+			const utils::OptDefinition&, probeplan::ProbePlan&);
+	std::string Join(const std::vector<std::string>&, std::string_view);
+}
+
+#endif  /* _EXPLORE_H_ */
@@ -30,68 +30,187 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <boost/filesystem.hpp>
-#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "fetch_groff.h"
 #include "logging.h"
+#include "thread_pool.h"
+
+const char *groff::srcdir = "../../../";
 
 /* Map of utility name and its location in src tree. */
 std::unordered_map<std::string, std::string> groff::groff_map;
+static std::mutex groff_map_lock;
+
+/* Checks whether "name" is a groff script for section 1 or section 8. */
+static bool
+IsGroffScript(const std::string& name)
+{
+	size_t len = name.size();
+
+	return len > 2 && name[len - 2] == '.' &&
+	       (name[len - 1] == '1' || name[len - 1] == '8');
+}
+
+/*
+ * Collects the values assigned (via "=", "+=", "?=" or ":=") to the
+ * variables PROG, PROG_CXX and MAN in the makefile at "path".
+ */
+static void
+ParseMakefile(const std::string& path,
+	      std::string& prog,
+	      std::vector<std::string>& man)
+{
+	std::ifstream file(path);
+	std::string line;
+	std::string statement;
+	std::string name;
+	std::string value;
+	size_t pos;
+
+	while (std::getline(file, line)) {
+		/* Join the continuation lines. */
+		if (!line.empty() && line.back() == '\\') {
+			line.pop_back();
+			statement += line + " ";
+			continue;
+		}
+		statement += line;
+
+		if ((pos = statement.find('=')) != std::string::npos &&
+		    pos > 0) {
+			name = statement.substr(0, pos);
+			if (strchr("+?:", name.back()) != NULL)
+				name.pop_back();
+			name.erase(name.find_last_not_of(" \t") + 1);
+			std::istringstream values(statement.substr(pos + 1));
+
+			if ((name == "PROG" || name == "PROG_CXX") &&
+			    values >> value && value.find('$') == std::string::npos)
+				prog = value;
+			else if (name == "MAN")
+				while (values >> value)
+					man.push_back(value);
+		}
+		statement.clear();
+	}
+}
+
+/*
+ * Looks for the utility built by the makefile in "dir" (if any), and
+ * records the location of its groff script in "groff_map".
+ */
+static void
+ScanDirectory(threadpool::ThreadPool& pool, std::string dir)
+{
+	std::vector<std::string> groff_scripts;
+	std::vector<std::string> man;
+	std::string prog;
+	std::string groffpath;
+	int best_rank = -1;
+	bool has_makefile = false;
+	bool has_tests = false;
+	struct dirent *ent;
+	struct stat sb;
+	DIR *dirp;
+
+	if ((dirp = opendir(dir.c_str())) == NULL) {
+		logging::LogPerror("opendir()");
+		return;
+	}
+
+	while ((ent = readdir(dirp)) != NULL) {
+		std::string name = ent->d_name;
+		bool is_dir = ent->d_type == DT_DIR;
+
+		/* Skip ".", ".." and the VCS metadata. */
+		if (name[0] == '.')
+			continue;
+		if (ent->d_type == DT_UNKNOWN)
+			is_dir = !stat((dir + name).c_str(), &sb) && S_ISDIR(sb.st_mode);
+
+		if (is_dir) {
+			if (name == "tests")
+				has_tests = true;
+			pool.Submit([&pool, dir, name] {
+				ScanDirectory(pool, dir + name + "/");
+			});
+		} else if (name == "Makefile") {
+			has_makefile = true;
+		} else if (IsGroffScript(name)) {
+			groff_scripts.push_back(name);
+		}
+	}
+	closedir(dirp);
+
+	/*
+	 * Record the groff script only if the utility does not already have
+	 * tests, i.e. the "tests" directory is absent.
+	 */
+	if (!has_makefile || has_tests || groff_scripts.empty())
+		return;
+	ParseMakefile(dir + "Makefile", prog, man);
+	if (prog.empty())
+		return;
+
+	/*
+	 * Prefer the groff script listed in MAN, then the one named after the
+	 * utility, and then any other groff script in the directory. Ties are
+	 * broken by name, so that the choice does not depend on the order of
+	 * the directory entries.
+	 */
+	for (const auto &name : groff_scripts) {
+		int rank = 0;
+
+		if (std::find(man.begin(), man.end(), name) != man.end())
+			rank = 2;
+		else if (name.size() == prog.size() + 2 &&
+			 name.compare(0, prog.size(), prog) == 0)
+			rank = 1;
+		if (rank > best_rank ||
+		    (rank == best_rank && dir + name < groffpath)) {
+			best_rank = rank;
+			groffpath = dir + name;
+		}
+	}
+
+	/*
+	 * A utility built in multiple directories is mapped to the smallest
+	 * path, regardless of the order in which the directories are scanned.
+	 */
+	std::lock_guard<std::mutex> guard(groff_map_lock);
+	auto it = groff::groff_map.emplace(prog, groffpath).first;
+	if (groffpath < it->second)
+		it->second = groffpath;
+}
 
 /*
- * Traverses the FreeBSD src tree looking for groff scripts for section 1 and
- * section 8 utilities and stores their location in a hashmap.
+ * Traverses the FreeBSD src tree (in parallel) looking for the utilities
+ * built by its makefiles, and stores the location of their groff scripts
+ * for section 1 and section 8 in a hashmap.
  */
 int
 groff::FetchGroffScripts()
 {
-	std::string utils_list = "scripts/utils_list";
-	std::string src = "../../../";  /* FreeBSD src. */
-	std::string utildir;
-	std::string utilname;
-	std::string path;
-	std::ifstream file;
-	std::regex section ("(.*).(?:1|8)");
+	std::string src = srcdir;
 	struct stat sb;
-	struct dirent *ent;
-	DIR *dir;
+	int workers = std::thread::hardware_concurrency();
 
-	/* Check if the file "scripts/utils_list" exists. */
-	if (stat(utils_list.c_str(), &sb) != 0) {
-		std::cerr << "scripts/utils_list does not exists.\n"
-			     "Run 'make fetch_utils' first.\n";
+	if (stat(src.c_str(), &sb) || !S_ISDIR(sb.st_mode)) {
+		std::cerr << "Unable to find the src tree at " << src << "\n";
 		return EXIT_FAILURE;
 	}
-	file.open(utils_list);
-
-	while (getline(file, utildir)) {
-		path = src + utildir + "/tests";
-		/*
-		 * Copy the groff script only if the utility does not already
-		 * have tests, i.e. the "tests" directory is absent.
-		 */
-		if (stat(path.c_str(), &sb) || !S_ISDIR(sb.st_mode)) {
-			path = src + utildir + "/";
-			utilname = utildir.substr(utildir.find_last_of("/") + 1);
-			if ((dir = opendir(path.c_str())) != NULL) {
-				while ((ent = readdir(dir)) != NULL) {
-					if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
-						continue;
-					} else if (std::regex_match(ent->d_name, section)) {
-						groff_map[utilname] = path + ent->d_name;
-					}
-				}
-				closedir(dir);
-			} else {
-				logging::LogPerror("opendir()");
-			}
-		}
-	}
 
-	file.close();
+	threadpool::ThreadPool pool(workers > 0 ? workers : 4);
+	pool.Submit([&pool, src] { ScanDirectory(pool, src); });
+	pool.Wait();
+
 	return EXIT_SUCCESS;
 }
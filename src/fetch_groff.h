@@ -32,6 +32,7 @@
 #include <unordered_map>
 
 namespace groff {
+	extern const char *srcdir;  /* Root of the FreeBSD src tree. */
 	extern std::unordered_map<std::string, std::string> groff_map;
 	int FetchGroffScripts();
 }
@@ -0,0 +1,200 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+#include "generate_annotations.h"
+#include "logging.h"
+#include "read_annotations.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+/* Locations where the tests of a utility are installed, in order. */
+static const char *const install_dirs[] = {
+	"/usr/tests/bin/",
+	"/usr/tests/usr.bin/",
+	"/usr/tests/usr.sbin/",
+	NULL
+};
+
+/*
+ * Guesses the directory where the test of "utility" is installed. Returns an
+ * empty string if it is not installed.
+ */
+static std::string
+InstallDir(std::string utility)
+{
+	struct stat sb;
+
+	for (int i = 0; install_dirs[i] != NULL; i++) {
+		std::string dir = install_dirs[i] + utility;
+		if (stat(dir.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode))
+			return dir;
+	}
+
+	return "";
+}
+
+/*
+ * Collects the testcases of "test" which failed in its latest run by kyua(1)
+ * inside "dir". The report is parsed as it is produced, i.e. in one pass.
+ */
+static void
+FailedTestcases(std::string test, std::string dir,
+		std::vector<std::string>& failed)
+{
+	std::string command = "cd '" + dir + "' && kyua report 2>/dev/null";
+	std::string prefix = test + ":";
+	std::string testcase;
+	std::string arrow;
+	std::string result;
+	char *line = NULL;
+	size_t linecap = 0;
+	FILE *pipe;
+
+	if ((pipe = popen(command.c_str(), "r")) == NULL) {
+		logging::LogPerror("popen()");
+		return;
+	}
+	/* Results are reported as "<test>:<testcase>  ->  <result>: ...". */
+	while (getline(&line, &linecap, pipe) > 0) {
+		std::istringstream fields(line);
+
+		if (fields >> testcase >> arrow >> result &&
+		    result == "failed:" && !testcase.compare(0, prefix.size(), prefix))
+			failed.push_back(testcase.substr(prefix.size()));
+	}
+	free(line);
+	pclose(pipe);
+}
+
+/*
+ * Appends the testcases in "failed" which are not yet present in the
+ * annotation file "path". Returns true if the file was modified.
+ */
+static bool
+UpdateAnnotations(std::string path, const std::vector<std::string>& failed)
+{
+	std::unordered_set<std::string> present;
+	std::ifstream file(path);
+	std::string data;
+	std::string line;
+	size_t size;
+
+	while (std::getline(file, line)) {
+		present.insert(line);
+		data += line + "\n";
+	}
+	file.close();
+
+	size = data.size();
+	for (const auto &testcase : failed) {
+		if (present.insert(testcase).second)
+			data += testcase + "\n";
+	}
+	if (data.size() == size)
+		return false;
+
+	if (!utils::WriteFileAtomic(path, data)) {
+		std::cerr << "Unable to write annotation file: " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Annotates the testcases of the tests under "testsdir" which failed in their
+ * latest (installed) run by kyua(1), so that they are skipped in the
+ * subsequent generations. The tests are processed by "jobs" workers.
+ */
+int
+annotations::GenerateAnnotations(const char *testsdir, int jobs)
+{
+	const std::string suffix = "_test.sh";
+	std::vector<std::string> modified;  /* Modified annotation files. */
+	std::mutex modified_lock;
+	boost::system::error_code error;
+	boost::filesystem::directory_iterator it(testsdir, error), end;
+
+	/* Nothing to annotate if no tests were generated. */
+	if (error)
+		return EXIT_SUCCESS;
+
+	boost::filesystem::create_directories("annotations", error);
+	threadpool::ThreadPool pool(jobs);
+	for (; it != end; it.increment(error)) {
+		std::string file = it->path().filename().string();
+
+		if (error)
+			break;
+		if (file.size() <= suffix.size() ||
+		    file.compare(file.size() - suffix.size(), suffix.size(), suffix))
+			continue;
+
+		pool.Submit([&, file] {
+			std::string test = file.substr(0, file.size() - 3);
+			std::string utility = file.substr(0, file.size()
+							  - suffix.size());
+			std::string dir = InstallDir(utility);
+			std::string annotation_file =
+				annotations::AnnotationFile(utility);
+			std::vector<std::string> failed;
+
+			if (dir.empty())
+				return;
+			FailedTestcases(test, dir, failed);
+			if (!UpdateAnnotations(annotation_file, failed))
+				return;
+
+			std::lock_guard<std::mutex> guard(modified_lock);
+			modified.push_back(annotation_file.substr
+					   (annotation_file.find('/') + 1));
+		});
+	}
+	pool.Wait();
+
+	if (!modified.empty()) {
+		std::sort(modified.begin(), modified.end());
+		std::cout << "\nModified annotation files -\n";
+		for (const auto &file : modified)
+			std::cout << "  * " << file << "\n";
+	}
+
+	return EXIT_SUCCESS;
+}
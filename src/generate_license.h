@@ -30,7 +30,7 @@
 #define _GENERATE_LICENSE_H_
 
 namespace generatelicense {
-	std::string GenerateLicense(int, char **);
+	std::string GenerateLicense(std::string);
 }
 
 #endif  /* _GENERATE_LICENSE_H_ */
@@ -26,23 +26,46 @@
  * $FreeBSD$
  */
 
-#include <dirent.h>
+#include <getopt.h>
 #include <signal.h>
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
-#include <fstream>
+#include <cerrno>
+#include <climits>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <unordered_set>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include "add_testcase.h"
+#include "executor.h"
+#include "explore.h"
 #include "fetch_groff.h"
+#include "generate_annotations.h"
 #include "generate_license.h"
 #include "generate_test.h"
 #include "logging.h"
+#include "option_index.h"
+#include "output_store.h"
+#include "probe_cache.h"
+#include "probe_plan.h"
 #include "read_annotations.h"
+#include "run_tests.h"
+#include "sandbox.h"
+#include "shard.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "watch.h"
+
+int generatetest::jobs = 1;
+
+/* Serializes updates to the progress table across worker threads. */
+static std::mutex progress_lock;
 
 void
 generatetest::IntHandler(int dummmy)
@@ -53,56 +76,178 @@ generatetest::IntHandler(int dummmy)
 	exit(EXIT_FAILURE);
 }
 
+void
+generatetest::Usage()
+{
+	std::cerr << "Usage: ./generate_tests [--name <copyright_owner>] "
+		     "[--jobs <N>] [--probes <N>]\n"
+		     "                      [--max-time <sec>] "
+		     "[--max-output <KB>] [--limit <resource>=<N>]\n"
+		     "                      [--cache-dir <dir>] "
+		     "[--cache-size <MB>] [--no-cache]\n"
+		     "                      [--split-output] [--repeat <N>] "
+		     "[--combinations <N>]\n"
+		     "                      [--tmpdir <dir>] "
+		     "[--index <file>] [--trace <file>]\n"
+		     "                      [--batch <N>] "
+		     "[--shard <i/N> [--output <dir>]]\n"
+		     "                      [--watch [--socket <path>]]\n"
+		     "       ./generate_tests --merge <dir> ...\n"
+		     "       ./generate_tests --annotate [--jobs <N>]\n"
+		     "       ./generate_tests --run [--jobs <N>] [<utility> ...]\n";
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Updates the progress table entry for a utility. When tests are generated
+ * by multiple workers, the intermediate updates (which overwrite the same
+ * terminal line via '\r') would interleave, hence only the final state of
+ * each utility is reported.
+ */
+void
+generatetest::ReportProgress(std::string util_with_section,
+			     int progress, int total)
+{
+#ifndef DEBUG
+	std::lock_guard<std::mutex> guard(progress_lock);
+
+	if (jobs > 1) {
+		if (progress == total)
+			std::cerr << std::setw(18) << util_with_section << " | "
+				  << progress << "/" << total << "\n";
+	} else if (isatty(fileno(stderr))) {
+		std::cerr << std::setw(18) << util_with_section << " | "
+			  << progress << "/" << total << "\r";
+	}
+#endif
+}
+
+/*
+ * Returns the diagnostic output of a command, i.e. its stderr if it was
+ * captured separately (and is non-empty), and its (combined) output
+ * otherwise.
+ */
+static outputstore::Output
+UsageMessage(const utils::ProbeResult& output)
+{
+	return output.error.empty() ? output.output : output.error;
+}
+
 /* [Batch mode] Generate a makefile for the test of given utility. */
 void
 generatetest::GenerateMakefile(std::string utility, std::string utildir)
 {
-	std::ofstream file;
+	addtestcase::Script file;
 
-	file.open(utildir + "/Makefile", std::ios::out);
 	file << "# $FreeBSD$\n\nATF_TESTS_SH+=  "
-		  + utility + "_test\n\n"
-		  + ".include <bsd.test.mk>\n";
-	file.close();
+	     << utility << "_test\n\n"
+	     << ".include <bsd.test.mk>\n";
+	file.Write(utildir + "/Makefile");
 }
 
-/* Generate a test for the given utility. */
-void
+/*
+ * Generate a test for the given utility, returns the number of testcases
+ * present in it.
+ */
+int
 generatetest::GenerateTest(std::string utility,
 			   char section,
 			   std::string& license,
-			   const char *testsdir)
+			   const char *testsdir,
+			   const char *copydir)
 {
-	std::vector<std::string> usage_messages;
-	std::vector<utils::OptRelation *> identified_opts;
-	std::string command;
+	std::vector<outputstore::Output> usage_messages;
+	std::vector<optcatalog::Index> identified_opts;
+	std::vector<std::vector<std::string>> combinations;
 	std::string testcase_list;
-	std::string buffer;
 	std::string testfile;
 	std::string util_with_section;
-	std::ofstream file;
-	std::pair<std::string, int> output;
-	std::unordered_set<std::string> annotation_set;
+	addtestcase::Script file;
+	addtestcase::Script buffer;  /* Body of the "invalid_usage" testcase. */
 	int progress = 0;  /* Number of options for which a testcase has been
 			      generated. */
 	bool usage_output = false;  /* Tracks whether '$usage_output' variable is used. */
+	bool no_arguments;  /* Whether the "no_arguments" testcase is generated. */
+
+	trace::Span span(utility, "utility");
 
-	/* Read annotations and populate hash set "annotation_set". */
-	annotations::read_annotations(utility, annotation_set);
 	util_with_section = utility + '(' + section + ')';
 	utils::OptDefinition opt_def;
-	identified_opts = opt_def.CheckOpts(utility);
+	{
+		trace::Span check_span("CheckOpts", "stage");
+		identified_opts = opt_def.CheckOpts(utility);
+		check_span.args.push_back({ "options",
+			std::to_string(opt_def.opt_list.size()) });
+	}
 	testfile = testsdir + utility + "_test.sh";
 
-#ifndef DEBUG
+	/*
+	 * Drop the options whose testcases are annotated, so that the commands
+	 * for them are not executed either.
+	 */
+	auto annotated = [&utility](const std::string& opt) {
+		return annotations::Annotated(utility,
+				addtestcase::TestcaseName(opt + "_flag"));
+	};
+	identified_opts.erase(std::remove_if(identified_opts.begin(),
+					     identified_opts.end(),
+					     [&](optcatalog::Index i) {
+						     return annotated(std::string(
+							optcatalog::catalog[i].value));
+					     }),
+			      identified_opts.end());
+	opt_def.opt_list.erase(std::remove_if(opt_def.opt_list.begin(),
+					      opt_def.opt_list.end(), annotated),
+			       opt_def.opt_list.end());
+	no_arguments = !annotations::Annotated(utility, "no_arguments");
+
 	/* Indicate the start of test generation for current utility. */
-	if (isatty(fileno(stderr))) {
-		std::cerr << std::setw(18) << util_with_section << " | "
-			  << progress << "/" << opt_def.opt_list.size() << "\r";
+	generatetest::ReportProgress(util_with_section, progress,
+				     opt_def.opt_list.size());
+	/*
+	 * Collect every command needed by the stages below, so that each of
+	 * them is executed exactly once.
+	 */
+	probeplan::ProbePlan plan(utility);
+	for (const auto &i : identified_opts)
+		plan.Add(std::string(optcatalog::catalog[i].value));
+	for (const auto &i : opt_def.opt_list)
+		plan.Add(i);
+	if (no_arguments)
+		plan.Add("");
+	{
+		trace::Span probe_span("probes", "stage");
+		plan.Run();
 	}
-#endif
+	{
+		trace::Span explore_span("combinations", "stage");
+		combinations = explore::Explore(utility, opt_def, plan);
+		explore_span.args.push_back({ "succeeded",
+			std::to_string(combinations.size()) });
+	}
+
+	/*
+	 * The commands which timed out were killed, so their results say
+	 * nothing about the utility; a testcase for them would hang as well.
+	 */
+	auto timedout = [&plan](const std::string& opt) {
+		return plan.Result(opt).timedout;
+	};
+	identified_opts.erase(std::remove_if(identified_opts.begin(),
+					     identified_opts.end(),
+					     [&](optcatalog::Index i) {
+						     return timedout(std::string(
+							optcatalog::catalog[i].value));
+					     }),
+			      identified_opts.end());
+	opt_def.opt_list.erase(std::remove_if(opt_def.opt_list.begin(),
+					      opt_def.opt_list.end(), timedout),
+			       opt_def.opt_list.end());
+	no_arguments = no_arguments && !timedout("");
+
+	trace::Span emit_span("emission", "stage");
+
 	/* Add license in the generated test scripts. */
-	file.open(testfile, std::ios::out);
 	file << license;
 
 	/*
@@ -113,33 +258,38 @@ generatetest::GenerateTest(std::string utility,
 	 * the supported options incorrectly.
 	 */
 	for (const auto &i : identified_opts) {
-		command = utils::GenerateCommand(utility, i->value);
-		output = utils::Execute(command);
-		if (boost::iequals(output.first.substr(0, 6), "usage:")) {
-			/* Our guessed usage is incorrect as usage message is produced. */
-			addtestcase::UnknownTestcase(i->value, util_with_section,
+		std::string opt(optcatalog::catalog[i].value);
+		const utils::ProbeResult& output = plan.Result(opt);
+		if (output.exitstatus ||
+		    boost::iequals(UsageMessage(output).view().substr(0, 6),
+				   "usage:")) {
+			/*
+			 * Our guessed usage is incorrect as the option failed, or
+			 * a usage message is produced.
+			 */
+			addtestcase::UnknownTestcase(opt, util_with_section,
 						     output, buffer, usage_output);
 		} else {
-			addtestcase::KnownTestcase(i->value, util_with_section,
-						   "", output.first, file);
+			addtestcase::KnownTestcase(opt, util_with_section,
+						   "", output, file);
+			testcase_list.append("\tatf_add_test_case "
+					     + addtestcase::TestcaseName(opt + "_flag")
+					     + "\n");
 		}
-		testcase_list.append("\tatf_add_test_case " + i->value + "_flag\n");
 	}
 
 	/*
 	 * Add testcases for the options whose usage is not yet known.  For the
 	 * purpose of adding a "$usage_output" variable, we choose the option
 	 * which produces one.
-	 * TODO Avoid double executions of an option, i.e. one while selecting
-	 * usage message and another while generating testcase.
 	 */
 	if (opt_def.opt_list.size() == 1) {
 		/* Check if the single option produces a usage message. */
-		command = utils::GenerateCommand(utility, opt_def.opt_list.front());
-		output = utils::Execute(command);
-		if (output.second && !output.first.empty()) {
+		const utils::ProbeResult& output =
+			plan.Result(opt_def.opt_list.front());
+		if (output.exitstatus && !UsageMessage(output).empty()) {
 			usage_output = true;
-			file << "usage_output=\'" + output.first + "\'\n\n";
+			file << "usage_output=\'" << UsageMessage(output) << "\'\n\n";
 		}
 	} else if (opt_def.opt_list.size() > 1) {
 		/*
@@ -149,138 +299,360 @@ generatetest::GenerateTest(std::string utility,
 		 * test script.
 		 */
 		for (const auto &i : opt_def.opt_list) {
-			command = utils::GenerateCommand(utility, i);
-			output = utils::Execute(command);
-			if (output.second && usage_messages.size() < 3)
-				usage_messages.push_back(output.first);
+			const utils::ProbeResult& output = plan.Result(i);
+			if (output.exitstatus && usage_messages.size() < 3)
+				usage_messages.push_back(UsageMessage(output));
 		}
 
+		/* The stored messages are compared via their handles. */
 		for (int j = 0; j < usage_messages.size(); j++) {
-			if (!usage_messages[j].compare
-					(usage_messages[(j+1) % usage_messages.size()])) {
+			if (usage_messages[j] ==
+			    usage_messages[(j+1) % usage_messages.size()]) {
 				usage_output = true;
 				file << "usage_output=\'"
-					      + output.first.substr(0, 7 + utility.size())
-					      + "\'\n\n";
+				     << usage_messages[j].view().substr(0, 7 + utility.size())
+				     << "\'\n\n";
 				break;
 			}
 		}
 	}
 
 	/*
-	 * Execute the utility with supported options, while adding positive
-	 * and negative testcases accordingly.
+	 * Add positive and negative testcases for the supported options
+	 * based on the results of their execution.
 	 */
 	for (const auto &i : opt_def.opt_list) {
-		/* Ignore the option if it is annotated. */
-		if (annotation_set.find(i) != annotation_set.end())
-			continue;
-
-		command = utils::GenerateCommand(utility, i);
-		output = utils::Execute(command);
-#ifndef DEBUG
-		if (isatty(fileno(stderr))) {
-			std::cerr << std::setw(18) << util_with_section
-				  << " | " << ++progress << "/"
-				  << opt_def.opt_list.size() << "\r";
-		}
-#endif
-		if (output.second) {
+		const utils::ProbeResult& output = plan.Result(i);
+		generatetest::ReportProgress(util_with_section, ++progress,
+					     opt_def.opt_list.size());
+		if (output.exitstatus) {
 			addtestcase::UnknownTestcase(i, util_with_section, output,
 						     buffer, usage_output);
 		} else {
 			/* Guessed usage is correct as EXIT_SUCCESS is encountered */
 			addtestcase::KnownTestcase(i, util_with_section, "",
-						   output.first, file);
+						   output, file);
 			testcase_list.append(std::string("\tatf_add_test_case ")
-					     + i + "_flag\n");
+					     + addtestcase::TestcaseName(i + "_flag")
+					     + "\n");
 		}
 	}
-	std::cout << std::endl;  /* Takes care of the last '\r'. */
+	if (generatetest::jobs == 1)
+		std::cout << std::endl;  /* Takes care of the last '\r'. */
+
+	/* Add testcases for the combinations of options which succeeded. */
+	for (const auto &i : combinations) {
+		addtestcase::CombinationTestcase(i, util_with_section,
+				plan.Result(explore::Join(i, " -")), file);
+		testcase_list.append("\tatf_add_test_case "
+				     + addtestcase::TestcaseName(
+					     explore::Join(i, "_") + "_flags")
+				     + "\n");
+	}
 
-	if (!opt_def.opt_list.empty()) {
+	/* The checks of the options which failed, if any. */
+	if (!buffer.str().empty()) {
 		testcase_list.append("\tatf_add_test_case invalid_usage\n");
 		file << "atf_test_case invalid_usage\ninvalid_usage_head()\n"
 			"{\n\tatf_set \"descr\" \"Verify that an invalid usage "
 			"with a supported option \" \\\n\t\t\t\"produces a valid "
 			"error message\"\n}\n\ninvalid_usage_body()\n{"
-		      + buffer + "\n}\n\n";
+		     << buffer.str() << "\n}\n\n";
 	}
 
 	/*
 	 * Add a testcase under "no_arguments" for running the utility without
 	 * any arguments.
 	 */
-	if (annotation_set.find("*") == annotation_set.end()) {
-		command = utils::GenerateCommand(utility, "");
-		output = utils::Execute(command);
-		addtestcase::NoArgsTestcase(util_with_section, output,
+	if (no_arguments) {
+		addtestcase::NoArgsTestcase(util_with_section, plan.Result(""),
 					    file, usage_output);
 		testcase_list.append("\tatf_add_test_case no_arguments\n");
 	}
 
-	file << "atf_init_test_cases()\n{\n" + testcase_list + "}\n";
-	file.close();
+	/* Every testcase may have been dropped, e.g. if all of them timed out. */
+	file << "atf_init_test_cases()\n{\n"
+	     << (testcase_list.empty() ? "\t:\n" : testcase_list) << "}\n";
+
+	/* The script is written out only once it is complete. */
+	file.Write(testfile);
+	if (copydir != NULL)
+		file.Write(copydir + utility + "_test.sh");
+
+	return std::count(testcase_list.begin(), testcase_list.end(), '\n');
+}
+
+/*
+ * Parses the numeric argument "arg" of an option, exiting via Usage() unless
+ * it is a decimal number within ["min", "max"].
+ */
+static long
+NumericArg(const char *arg, long min, long max)
+{
+	char *end;
+	long value;
+
+	errno = 0;
+	value = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || errno != 0 || value < min ||
+	    value > max)
+		generatetest::Usage();
+	return value;
 }
 
 int
 main(int argc, char **argv)
 {
-	std::ifstream groff_list;
 	struct stat sb;
-	struct dirent *ent;
 	char answer;
+	int opt;
 	std::string license;
-	std::string utildir;  /* Path to utility in src tree. */
-	std::string groffpath;
+	std::string copyright_owner;
+	std::vector<std::string> selected;  /* Utilities to generate tests for. */
 	const char *testsdir = "generated_tests/";
+	std::string outdir;        /* Output directory of a shard. */
+	std::string shard_testsdir;
+	std::string tmpdir_path;
+	std::string tmproot;       /* Directory to create "tmpdir" in. */
+	std::map<std::string, shard::Stat> stats;
+	std::mutex stats_lock;
+	int status = EXIT_SUCCESS;
+	bool merge = false;        /* Merge the outputs of shards. */
+	bool annotate = false;     /* Annotate the failed testcases. */
+	bool run = false;          /* Run the generated tests. */
+	bool jobs_set = false;
+	bool watch_mode = false;   /* Regenerate the tests on changes. */
+	bool interactive = true;   /* Prompt for running in batch mode. */
 	/*
 	 * Instead of generating tests for all the utilities, "batch mode"
 	 * allows generation of tests for first "batch_limit" number of
-	 * utilities selected from "scripts/utils_list".
+	 * utilities found in the src tree.
 	 */
 	bool batch_mode = false;
 	int batch_limit;  /* Number of tests to be generated in batch mode. */
+	static struct option longopts[] = {
+		{ "name",         required_argument, NULL, 'n' },
+		{ "jobs",         required_argument, NULL, 'j' },
+		{ "probes",       required_argument, NULL, 'p' },
+		{ "max-time",     required_argument, NULL, 'M' },
+		{ "max-output",   required_argument, NULL, 'O' },
+		{ "limit",        required_argument, NULL, 'L' },
+		{ "cache-dir",    required_argument, NULL, 'c' },
+		{ "cache-size",   required_argument, NULL, 's' },
+		{ "no-cache",     no_argument,       NULL, 'C' },
+		{ "split-output", no_argument,       NULL, 'S' },
+		{ "repeat",       required_argument, NULL, 'R' },
+		{ "combinations", required_argument, NULL, 'x' },
+		{ "index",        required_argument, NULL, 'i' },
+		{ "trace",        required_argument, NULL, 't' },
+		{ "batch",        required_argument, NULL, 'b' },
+		{ "shard",        required_argument, NULL, 'd' },
+		{ "output",       required_argument, NULL, 'o' },
+		{ "merge",        no_argument,       NULL, 'm' },
+		{ "tmpdir",       required_argument, NULL, 'T' },
+		{ "watch",        no_argument,       NULL, 'w' },
+		{ "socket",       required_argument, NULL, 'u' },
+		{ "annotate",     no_argument,       NULL, 'a' },
+		{ "run",          no_argument,       NULL, 'r' },
+		{ NULL,           0,                 NULL, 0 }
+	};
 
-	signal(SIGINT, generatetest::IntHandler);
+	while ((opt = getopt_long(argc, argv, "n:j:p:M:O:L:c:s:CSR:x:i:t:b:d:o:mT:wu:ar", longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			copyright_owner = optarg;
+			break;
+		case 'j':
+			generatetest::jobs = NumericArg(optarg, 1, INT_MAX);
+			jobs_set = true;
+			break;
+		case 'p':
+			executor::max_probes = NumericArg(optarg, 1, INT_MAX);
+			break;
+		case 'M':
+			executor::max_time = NumericArg(optarg, 1, INT_MAX);
+			break;
+		case 'O':
+			executor::max_output = NumericArg(optarg, 1,
+							  LONG_MAX >> 10);
+			executor::max_output <<= 10;  /* KB */
+			break;
+		case 'L':
+			if (!utils::ParseLimit(optarg))
+				generatetest::Usage();
+			break;
+		case 'c':
+			probecache::cachedir = optarg;
+			break;
+		case 's':
+			probecache::max_size = NumericArg(optarg, 1,
+							  LONG_MAX >> 20);
+			probecache::max_size <<= 20;  /* MB */
+			break;
+		case 'C':
+			probecache::enabled = false;
+			break;
+		case 'S':
+			utils::split_output = true;
+			break;
+		case 'R':
+			utils::repeat = NumericArg(optarg, 1, INT_MAX);
+			break;
+		case 'x':
+			explore::budget = NumericArg(optarg, 0, LONG_MAX);
+			break;
+		case 'i':
+			optionindex::indexfile = optarg;
+			break;
+		case 't':
+			trace::tracefile = optarg;
+			break;
+		case 'b':
+			batch_mode = true;
+			interactive = false;
+			batch_limit = NumericArg(optarg, 1, INT_MAX);
+			break;
+		case 'd':
+			interactive = false;
+			if (!shard::Parse(optarg))
+				generatetest::Usage();
+			break;
+		case 'o':
+			outdir = optarg;
+			break;
+		case 'm':
+			merge = true;
+			break;
+		case 'T':
+			tmproot = optarg;
+			break;
+		case 'w':
+			watch_mode = true;
+			interactive = false;
+			break;
+		case 'u':
+			watch::socketpath = optarg;
+			break;
+		case 'a':
+			annotate = true;
+			break;
+		case 'r':
+			run = true;
+			break;
+		default:
+			generatetest::Usage();
+		}
+	}
 
-	if (groff::FetchGroffScripts() == EXIT_FAILURE)
+	/* Combine the outputs of the shards passed as arguments. */
+	if (merge) {
+		if (optind == argc)
+			generatetest::Usage();
+		return shard::Merge(std::vector<std::string>(argv + optind,
+							     argv + argc),
+				    testsdir);
+	}
+	if ((optind != argc && !run) || (!outdir.empty() && shard::count == 0))
+		generatetest::Usage();
+	/* Annotate the testcases which failed in the latest kyua(1) run. */
+	if (annotate)
+		return annotations::GenerateAnnotations(testsdir,
+							generatetest::jobs);
+	if (watch_mode && !watch::Listen())
 		return EXIT_FAILURE;
 
+	/*
+	 * A shard keeps all of its output (and side effects) under its own
+	 * directory, so that multiple shards can be run from the same tree.
+	 */
+	if (shard::count > 0) {
+		if (outdir.empty())
+			outdir = "shard." + std::to_string(shard::index);
+		shard_testsdir = outdir + "/generated_tests/";
+		tmpdir_path = outdir + "/tmpdir";
+		testsdir = shard_testsdir.c_str();
+		utils::tmpdir = tmpdir_path.c_str();
+	}
+
+	/*
+	 * Place "tmpdir" under the given directory instead, e.g. on a tmpfs
+	 * so that the side effects of the commands never hit the disk.
+	 */
+	if (!tmproot.empty()) {
+		tmpdir_path = tmproot + "/smoketestsuite.XXXXXX";
+		if (mkdtemp(&tmpdir_path[0]) == NULL) {
+			logging::LogPerror("mkdtemp()");
+			return EXIT_FAILURE;
+		}
+		utils::tmpdir = tmpdir_path.c_str();
+	}
+
+	signal(SIGINT, generatetest::IntHandler);
+
+	/*
+	 * Run the generated tests, by default executing as many testcases
+	 * concurrently as there are CPUs.
+	 */
+	if (run) {
+		if (!jobs_set)
+			generatetest::jobs = std::max(1U,
+				std::thread::hardware_concurrency());
+		boost::filesystem::create_directories(utils::tmpdir);
+		sandbox::Init(generatetest::jobs);
+		status = runtests::RunTests(testsdir,
+			std::vector<std::string>(argv + optind, argv + argc),
+			generatetest::jobs);
+		boost::filesystem::remove_all(utils::tmpdir);
+		return status;
+	}
+
+	{
+		trace::Span span("discovery", "stage");
+		if (groff::FetchGroffScripts() == EXIT_FAILURE)
+			return EXIT_FAILURE;
+	}
+
+	/* Load the options of the utilities whose man pages are unchanged. */
+	optionindex::Load();
+
 	/*
 	 * Create a temporary directory where all the side-effects introduced
 	 * by utility-specific commands are restricted.
 	 */
-	boost::filesystem::create_directory(utils::tmpdir);
-
-	std::cout << "\nInstead of generating tests for all the utilities, 'batch mode'\n"
-		     "allows generation of tests for first N utilities selected from\n"
-		     "'scripts/utils_list', and places them at their correct location\n"
-		     "in the src tree, with corresponding makefiles created.\n"
-		     "Run in 'batch mode' ? [y/N] ";
-	std::cin.get(answer);
-
-	switch(answer) {
-	case 'y':
-	case 'Y':
-		batch_mode = true;
-		std::cout << "Number of utilities to select for test generation: ";
-		std::cin >> batch_limit;
-
-		if (batch_limit <= 0) {
-			std::cerr << "Invalid input. Exiting...\n";
-			return EXIT_FAILURE;
+	boost::filesystem::create_directories(utils::tmpdir);
+	sandbox::Init(generatetest::jobs * executor::max_probes);
+	probecache::Init();
+
+	if (interactive) {
+		std::cout << "\nInstead of generating tests for all the utilities, 'batch mode'\n"
+			     "allows generation of tests for first N utilities selected from\n"
+			     "the src tree, and places them at their correct location\n"
+			     "in the src tree, with corresponding makefiles created.\n"
+			     "Run in 'batch mode' ? [y/N] ";
+		std::cin.get(answer);
+
+		switch(answer) {
+		case 'y':
+		case 'Y':
+			batch_mode = true;
+			std::cout << "Number of utilities to select for test generation: ";
+			std::cin >> batch_limit;
+
+			if (batch_limit <= 0) {
+				std::cerr << "Invalid input. Exiting...\n";
+				return EXIT_FAILURE;
+			}
+			break;
+		case '\n':
+		default:
+			break;
 		}
-		break;
-	case '\n':
-	default:
-		break;
 	}
 
 	/* Check if the directory "testsdir" exists. */
 	if (stat(testsdir, &sb) || !S_ISDIR(sb.st_mode)) {
 		boost::filesystem::path dir(testsdir);
-		if (boost::filesystem::create_directory(dir))
+		if (boost::filesystem::create_directories(dir))
 			std::cout << "Directory created: " << testsdir << "\n";
 		else {
 			std::cerr << "Unable to create directory: " << testsdir << "\n";
@@ -289,7 +661,7 @@ main(int argc, char **argv)
 	}
 
 	/* Generate a license to be added in the generated scripts. */
-	license = generatelicense::GenerateLicense(argc, argv);
+	license = generatelicense::GenerateLicense(copyright_owner);
 
 #ifndef DEBUG
 	/* Generate a tabular-like format. */
@@ -298,40 +670,100 @@ main(int argc, char **argv)
 	std::cout << std::setw(32) << "----------+-----------\n";
 #endif
 
-	if (batch_mode) {
-		std::string command;
-		std::unordered_map<std::string, std::string>::iterator it;
+	/*
+	 * In batch mode, select first "batch_limit" number of utilities found
+	 * in the src tree (in alphabetical order, so that the selection does
+	 * not depend on the traversal), and then the ones in this shard.
+	 */
+	for (const auto &it : groff::groff_map)
+		selected.push_back(it.first);
+	std::sort(selected.begin(), selected.end());
+	if (batch_mode && (size_t)batch_limit < selected.size())
+		selected.resize(batch_limit);
+	explore::Init(selected);
+	selected.erase(std::remove_if(selected.begin(), selected.end(),
+				      [](const std::string& utility) {
+					      return !shard::Selected(utility);
+				      }),
+		       selected.end());
 
-		/*
-		 * Generate tests for first "batch_limit" number of utilities
-		 * selected from "scripts/utils_list".
-		 */
-		it = groff::groff_map.begin();
-		while (batch_limit-- && it != groff::groff_map.end()) {
-			groffpath = groff::groff_map.at(it->first);
+	/* Generates the test of a utility, recording its statistics. */
+	auto generate_test = [&](std::string utility) {
+		std::string groffpath = groff::groff_map.at(utility);
+		char section = groffpath.back();
+		std::string utildir;
+		int testcases;
+
+		if (!batch_mode) {
+			testcases = generatetest::GenerateTest
+				(utility, section, license, testsdir);
+		} else {
+			/* Path to utility in src tree. */
 			utildir = groffpath.substr
-				(0, groffpath.size() - 2 - it->first.size());
+				(0, groffpath.find_last_of('/') + 1);
 			utildir += "tests/";
+			/* A shard mirrors the src tree under its output. */
+			if (shard::count > 0) {
+				utildir = outdir + "/src/"
+					+ utildir.substr(strlen(groff::srcdir));
+			}
 
-			/* Populate "tests/" directory. */
-			boost::filesystem::remove_all(utildir);
-			boost::filesystem::create_directory(utildir);
-			generatetest::GenerateMakefile(it->first, utildir);
-			generatetest::GenerateTest(it->first, it->second.back(),
-						   license, utildir.c_str());
-			boost::filesystem::copy_file(utildir + it->first + "_test.sh",
-				testsdir + it->first + "_test.sh",
-				boost::filesystem::copy_option::overwrite_if_exists);
-			std::advance(it, 1);
+			/*
+			 * Populate "tests/" directory, keeping a copy
+			 * of the test under "testsdir".
+			 */
+			boost::filesystem::create_directories(utildir);
+			generatetest::GenerateMakefile(utility, utildir);
+			testcases = generatetest::GenerateTest
+				(utility, section, license,
+				 utildir.c_str(), testsdir);
 		}
-	} else {
-		for (const auto &it : groff::groff_map) {
-			generatetest::GenerateTest(it.first, it.second.back(),
-						   license, testsdir);
-		}
-	}
+
+		std::lock_guard<std::mutex> guard(stats_lock);
+		stats[utility] = { utility, section, testcases };
+	};
+
+	/*
+	 * Test generation for a utility is independent of that for the
+	 * others, hence the utilities are distributed among "jobs" workers.
+	 */
+	threadpool::ThreadPool pool(generatetest::jobs);
+
+	auto generate = [&](const std::vector<std::string>& utilities) {
+		std::map<std::string, int> testcases;
+		std::vector<shard::Stat> stats_list;
+
+		/* Reloaded for every round of "--watch". */
+		annotations::Load();
+		for (const auto &utility : utilities)
+			pool.Submit([&, utility] { generate_test(utility); });
+		pool.Wait();
+
+		for (const auto &utility : utilities)
+			testcases[utility] = stats.at(utility).testcases;
+		for (const auto &it : stats)
+			stats_list.push_back(it.second);
+		shard::WriteStats(shard::count > 0 ? outdir + "/stats" : "stats",
+				  stats_list);
+		trace::Write();
+		optionindex::Save();
+		probecache::Flush();
+		/* No result of this round outlives it. */
+		outputstore::Clear();
+		return testcases;
+	};
+
+	/*
+	 * With "--watch", the tests are kept up to date with the src tree
+	 * until interrupted.
+	 */
+	if (watch_mode)
+		status = watch::Run(selected, generate);
+	else
+		generate(selected);
+	probecache::Evict();
 
 	/* Cleanup. */
 	boost::filesystem::remove_all(utils::tmpdir);
-	return EXIT_SUCCESS;
+	return status;
 }
@@ -32,10 +32,14 @@
 #include "utils.h"
 
 namespace generatetest {
+	extern int jobs;  /* Number of utilities processed concurrently. */
+
 	void IntHandler(int);
+	void Usage();
+	void ReportProgress(std::string, int, int);
 	void GenerateMakefile(std::string, std::string);
-	void GenerateTest(std::string, char,
-			  std::string&, const char*);
+	int GenerateTest(std::string, char,
+			  std::string&, const char*, const char* = NULL);
 }
 
 #endif  /* _GENERATE_TEST_H_ */
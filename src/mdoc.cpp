@@ -0,0 +1,396 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "mdoc.h"
+#include "logging.h"
+
+/* Callable macros, i.e. the ones which can appear as arguments of a macro. */
+static const char *const callable_macros[] = {
+	"Ac", "Ad", "An", "Ao", "Aq", "Ar", "At", "Bc", "Bo", "Bq", "Brc",
+	"Bro", "Brq", "Bsx", "Bx", "Cd", "Cm", "Dc", "Do", "Dq", "Dv", "Dx",
+	"Ec", "Em", "Eo", "Er", "Ev", "Fa", "Fc", "Fl", "Fn", "Fo", "Fr",
+	"Fx", "Ic", "Li", "Lk", "Ms", "Mt", "Nm", "No", "Ns", "Nx", "Oc",
+	"Oo", "Op", "Ot", "Ox", "Pa", "Pc", "Pf", "Po", "Pq", "Qc", "Ql",
+	"Qo", "Qq", "Sc", "So", "Sq", "St", "Sx", "Sy", "Tn", "Ux", "Va",
+	"Vt", "Xc", "Xo", "Xr"
+};
+
+static bool
+IsCallable(std::string_view token)
+{
+	for (const auto &macro : callable_macros) {
+		if (token == macro)
+			return true;
+	}
+
+	return false;
+}
+
+/* Strips the escape sequences which commonly appear in option names. */
+static std::string
+Unescape(std::string_view word)
+{
+	std::string name;
+
+	for (size_t i = 0; i < word.size(); i++) {
+		if (word[i] == '\\' && i + 1 < word.size()) {
+			if (word[i + 1] == '-')
+				name.push_back('-');
+			/* "\&" is a zero-width space, drop it. */
+			i++;
+			continue;
+		}
+		name.push_back(word[i]);
+	}
+
+	return name;
+}
+
+/*
+ * Splits the arguments of a macro line into "tokens", the first of which is
+ * the name of the macro. Quoted arguments are kept as a single token (without
+ * the quotes). The vector is reused between lines to avoid reallocations.
+ */
+static void
+Tokenize(std::string_view line, std::vector<std::string_view>& tokens)
+{
+	size_t pos = 0;
+	size_t end;
+
+	tokens.clear();
+	while (pos < line.size()) {
+		if (line[pos] == ' ' || line[pos] == '\t') {
+			pos++;
+			continue;
+		}
+		if (line[pos] == '"') {
+			if ((end = line.find('"', ++pos)) == std::string_view::npos)
+				end = line.size();
+			tokens.push_back(line.substr(pos, end - pos));
+			pos = end + 1;
+			continue;
+		}
+		end = line.find_first_of(" \t", pos);
+		if (end == std::string_view::npos)
+			end = line.size();
+		tokens.push_back(line.substr(pos, end - pos));
+		pos = end;
+	}
+}
+
+/* Number of bits of mdoc::Option::forms. */
+#define MAX_FORMS 16
+
+/*
+ * State of the SYNOPSIS section, which is carried over between its lines
+ * since an "Oo ... Oc" group can span multiple lines.
+ */
+struct Synopsis {
+	unsigned form;     /* Current form, counted from 0. */
+	unsigned groups;   /* Number of exclusive groups so far. */
+	size_t first;      /* First option of the current group. */
+	int depth;         /* Nesting of the current group, 0 if none. */
+	bool exclusive;    /* A '|' appeared in the current group. */
+};
+
+/*
+ * Ends the current group of the synopsis, the options of which are mutually
+ * exclusive if they are separated by '|'.
+ */
+static void
+CloseGroup(Synopsis *synopsis, std::vector<mdoc::Option>& options)
+{
+	if (synopsis->exclusive && options.size() - synopsis->first > 1) {
+		synopsis->groups++;
+		for (size_t i = synopsis->first; i < options.size(); i++)
+			options[i].group = synopsis->groups;
+	}
+	synopsis->depth = 0;
+	synopsis->exclusive = false;
+}
+
+/*
+ * Collects the options named by "Fl" macros present in "tokens" into
+ * "options", along with the kind of argument they accept. Returns the number
+ * of collected options. The options of the SYNOPSIS section (i.e. if
+ * "synopsis" is non-NULL) are split into clusters, and are grouped.
+ *
+ * 	.It Fl r Ar seconds          "r" (requires an argument)
+ * 	.It Fl a , Fl -all           "a" and "-all"
+ * 	.Fl Fl version               "-version"
+ * 	.Op Fl jnRu                  "j", "n", "R" and "u" (in the synopsis)
+ * 	.Op Fl H | Fl L | Fl P       "H", "L" and "P" (mutually exclusive)
+ */
+static size_t
+CollectFlags(const std::vector<std::string_view>& tokens,
+	     std::vector<mdoc::Option>& options, Synopsis *synopsis)
+{
+	size_t count = 0;
+	bool optional = false;  /* Inside "Op" or "Oo ... Oc". */
+	size_t last = options.size();  /* Option preceding an "Ar". */
+	size_t first = options.size();
+	int opened = 0;  /* Number of "Op" groups opened on this line. */
+
+	for (size_t i = 0; i < tokens.size(); i++) {
+		if (tokens[i] == "Op" || tokens[i] == "Oo") {
+			optional = true;
+			if (synopsis == NULL)
+				continue;
+			if (tokens[i] == "Op")
+				opened++;
+			if (synopsis->depth++ == 0) {
+				synopsis->first = options.size();
+				synopsis->exclusive = false;
+			}
+		} else if (tokens[i] == "Oc") {
+			optional = false;
+			if (synopsis != NULL && synopsis->depth > 0 &&
+			    --synopsis->depth == 0)
+				CloseGroup(synopsis, options);
+		} else if (tokens[i] == "|") {
+			if (synopsis != NULL && synopsis->depth > 0)
+				synopsis->exclusive = true;
+		} else if (tokens[i] == "Ar") {
+			if (last < options.size() &&
+			    options[last].arg == mdoc::ARG_NONE)
+				options[last].arg = optional ? mdoc::ARG_OPTIONAL
+							     : mdoc::ARG_REQUIRED;
+		} else if (tokens[i] == "Fl") {
+			std::string name;
+
+			/* "Fl Fl word" renders as "--word". */
+			while (i + 1 < tokens.size() && tokens[i + 1] == "Fl") {
+				name.push_back('-');
+				i++;
+			}
+			if (i + 1 < tokens.size() && !IsCallable(tokens[i + 1]))
+				name.append(Unescape(tokens[++i]));
+			if (name.empty() || name == "-") {
+				/* A lone dash, e.g. "Fl" in tset(1). */
+				last = options.size();
+				continue;
+			}
+
+			if (synopsis != NULL && name.size() > 1 &&
+			    name[0] != '-') {
+				/* A cluster of short options. */
+				for (const auto &c : name) {
+					options.push_back({std::string(1, c),
+							   mdoc::ARG_NONE, {}, 0, 0});
+					count++;
+				}
+				/* Arguments are not attributed to clusters. */
+				last = options.size();
+				continue;
+			}
+			last = options.size();
+			options.push_back({name, mdoc::ARG_NONE, {}, 0, 0});
+			count++;
+		}
+		/* Delimiters and other macros are skipped. */
+	}
+
+	if (synopsis != NULL) {
+		for (size_t i = first; i < options.size(); i++)
+			options[i].forms = 1U << synopsis->form;
+		/* "Op" encloses the rest of its line. */
+		if (opened > 0) {
+			synopsis->depth = std::max(synopsis->depth - opened, 0);
+			if (synopsis->depth == 0)
+				CloseGroup(synopsis, options);
+		}
+	}
+
+	return count;
+}
+
+mdoc::Page::Page() : data(NULL), size(0)
+{
+}
+
+mdoc::Page::~Page()
+{
+	if (data != NULL)
+		munmap((void *)data, size);
+}
+
+/* Maps the man page at "path" in memory and collects the options described in it. */
+bool
+mdoc::Page::Open(std::string path)
+{
+	struct stat sb;
+	void *addr;
+	int fd;
+
+	if ((fd = open(path.c_str(), O_RDONLY)) < 0) {
+		logging::LogPerror("open()");
+		return false;
+	}
+	if (fstat(fd, &sb) < 0) {
+		logging::LogPerror("fstat()");
+		close(fd);
+		return false;
+	}
+	if (sb.st_size == 0) {
+		/* Nothing to map. */
+		close(fd);
+		return true;
+	}
+
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		logging::LogPerror("mmap()");
+		return false;
+	}
+	posix_madvise(addr, sb.st_size, POSIX_MADV_SEQUENTIAL);
+	data = (const char *)addr;
+	size = sb.st_size;
+	Parse();
+
+	return true;
+}
+
+/*
+ * Tokenizes the macro lines of the page in a single pass. The description of
+ * an option spans the lines following its ".It" line, until the next item of
+ * the same list (nested lists are a part of the description).
+ */
+void
+mdoc::Page::Parse()
+{
+	struct Item {
+		int depth;     /* Nesting level of the list. */
+		size_t first;  /* Index of the first option of the item. */
+		const char *start;
+	};
+	std::string_view text(data, size);
+	std::string_view line;
+	std::vector<std::string_view> tokens;
+	std::vector<Item> items;  /* Items whose description is being read. */
+	std::vector<Option> synopsis;
+	Synopsis state = {};
+	bool in_synopsis = false;
+	int depth = 0;
+	size_t pos = 0;
+	size_t end;
+	size_t count;
+
+	/* Sets the descriptions of the items nested at least at "level". */
+	auto close_items = [&](int level, const char *at) {
+		while (!items.empty() && items.back().depth >= level) {
+			for (size_t i = items.back().first; i < options.size(); i++)
+				options[i].description =
+					std::string_view(items.back().start,
+							 at - items.back().start);
+			items.pop_back();
+		}
+	};
+
+	while (pos < text.size()) {
+		if ((end = text.find('\n', pos)) == std::string_view::npos)
+			end = text.size();
+		line = text.substr(pos, end - pos);
+		pos = end + 1;
+
+		/* Only the macro lines are of interest, skipping the comments. */
+		if (line.empty() || (line[0] != '.' && line[0] != '\'') ||
+		    line.compare(1, 2, "\\\"") == 0)
+			continue;
+		Tokenize(line.substr(1), tokens);
+		if (tokens.empty())
+			continue;
+
+		if (tokens[0] == "Sh" || tokens[0] == "Ss") {
+			close_items(0, line.data());
+			if (tokens[0] == "Sh")
+				in_synopsis = tokens.size() > 1 &&
+					      tokens[1] == "SYNOPSIS";
+		} else if (tokens[0] == "Bl") {
+			depth++;
+		} else if (tokens[0] == "El") {
+			close_items(depth, line.data());
+			depth--;
+		} else if (tokens[0] == "It") {
+			close_items(depth, line.data());
+			count = CollectFlags(tokens, options, NULL);
+			if (count)
+				items.push_back({depth, options.size() - count,
+						 text.data() + std::min(pos, text.size())});
+		} else if (in_synopsis) {
+			/* Every ".Nm" line (but the first) starts a new form. */
+			if (tokens[0] == "Nm" && !synopsis.empty()) {
+				CloseGroup(&state, synopsis);
+				state.form = std::min(state.form + 1,
+						      MAX_FORMS - 1U);
+			}
+			CollectFlags(tokens, synopsis, &state);
+		}
+	}
+	close_items(0, text.data() + text.size());
+
+	/*
+	 * Keep the options which are not described elsewhere, and carry the
+	 * grouping of the synopsis over to the described ones.
+	 */
+	std::unordered_map<std::string, size_t> grouped;
+	for (size_t i = 0; i < synopsis.size(); i++) {
+		auto it = grouped.emplace(synopsis[i].name, i);
+		if (!it.second) {
+			/* Listed more than once, e.g. in multiple forms. */
+			Option& opt = synopsis[it.first->second];
+			opt.forms |= synopsis[i].forms;
+			if (opt.group == 0)
+				opt.group = synopsis[i].group;
+		}
+	}
+	for (auto &opt : options) {
+		auto it = grouped.find(opt.name);
+		if (it != grouped.end()) {
+			opt.group = synopsis[it->second].group;
+			opt.forms = synopsis[it->second].forms;
+		}
+	}
+
+	std::unordered_set<std::string> described;
+	for (const auto &opt : options)
+		described.insert(opt.name);
+	for (auto &opt : synopsis) {
+		if (described.insert(opt.name).second)
+			synopsis_options.push_back(std::move(opt));
+	}
+}
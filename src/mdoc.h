@@ -0,0 +1,93 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _MDOC_H_
+#define _MDOC_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mdoc {
+	/* Argument accepted by an option. */
+	enum ArgKind {
+		ARG_NONE,
+		ARG_REQUIRED,  /* .Fl x Ar arg */
+		ARG_OPTIONAL   /* .Fl x Op Ar arg */
+	};
+
+	/*
+	 * An option documented in a man page. Long options are named with a
+	 * single leading '-', e.g. "-version" for "--version".
+	 */
+	struct Option {
+		std::string name;
+		ArgKind arg;
+		/* Text following the option in a tagged list (if any). */
+		std::string_view description;
+		/*
+		 * Group of mutually exclusive options it belongs to in the
+		 * SYNOPSIS, e.g. ".Op Fl a | Fl b" (0 if none).
+		 */
+		unsigned group;
+		/*
+		 * Forms of the SYNOPSIS (i.e. ".Nm" lines, the 16th onwards
+		 * sharing the last bit) the option appears in, as a bitmask.
+		 * Options of disjoint forms are mutually exclusive.
+		 */
+		unsigned forms;
+	};
+
+	/*
+	 * A man page (written using the mdoc(7) macros) mapped in memory. The
+	 * option descriptions point inside the mapping, hence are valid only
+	 * for the lifetime of the page.
+	 */
+	class Page {
+	public:
+		Page();
+		~Page();
+		Page(const Page&) = delete;
+		Page& operator=(const Page&) = delete;
+
+		bool Open(std::string);
+
+		/* Options described via ".It Fl", in order of appearance. */
+		std::vector<Option> options;
+		/* Options present only in the SYNOPSIS section. */
+		std::vector<Option> synopsis_options;
+
+	private:
+		const char *data;
+		size_t size;
+
+		void Parse();
+	};
+}
+
+#endif  /* _MDOC_H_ */
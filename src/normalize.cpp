@@ -0,0 +1,351 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/param.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <regex>
+
+#include "normalize.h"
+#include "utils.h"
+
+/* Pattern for a differing range which no normalizer recognizes. */
+#define ANY ".*"
+
+/*
+ * A normalizer recognizes a class of text which differs between executions,
+ * runs or hosts, and supplies the pattern such text is checked against.
+ */
+struct Normalizer {
+	std::regex regex;
+	std::string pattern;  /* Empty for the shape of the text, see Shape(). */
+};
+
+/* Range [begin, end) of a line which is checked against "pattern". */
+struct Segment {
+	size_t begin;
+	size_t end;
+	std::string pattern;
+};
+
+/*
+ * Escapes the characters special in an extended regular expression (a lone
+ * ']' or '}' is not special).
+ */
+static std::string
+Escape(std::string_view text)
+{
+	std::string escaped;
+
+	for (const auto &c : text) {
+		if (c != '\0' && strchr("\\.[()*+?{|^$", c) != NULL)
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+/* Class of a character for Shape(): 1 (digit), 2 (letter), 3 (blank), 0. */
+static int
+Class(unsigned char c)
+{
+	return isdigit(c) ? 1 : isalpha(c) ? 2 : c == ' ' ? 3 : 0;
+}
+
+/*
+ * Returns a pattern for the text of the same shape as "text", i.e. with every
+ * run of digits, letters and blanks generalized, e.g. "Oct  8 06:37" becomes
+ * "[A-Za-z]+ +[0-9]+ +[0-9]+:[0-9]+".
+ */
+static std::string
+Shape(std::string_view text)
+{
+	static const char *runs[] = { NULL, "[0-9]+", "[A-Za-z]+", " +" };
+	std::string pattern;
+	size_t i = 0;
+	int c;
+
+	while (i < text.size()) {
+		if ((c = Class(text[i])) == 0) {
+			pattern += Escape(text.substr(i++, 1));
+			continue;
+		}
+		while (i < text.size() && Class(text[i]) == c)
+			i++;
+		pattern += runs[c];
+	}
+	return pattern;
+}
+
+/* Compiles the normalizers, the first matching one takes precedence. */
+static std::vector<Normalizer>
+Compile()
+{
+	std::vector<Normalizer> normalizers;
+	char hostname[MAXHOSTNAMELEN];
+	char path[PATH_MAX];
+	std::string name;
+
+	/* Timestamps, e.g. of date(1) and ls(1) -l, and ISO 8601 ones. */
+	normalizers.push_back({ std::regex(
+		"\\b(Mon|Tue|Wed|Thu|Fri|Sat|Sun),? +([0-9]{1,2} +)?"
+		"(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) +[0-9]{1,4}"
+		"( +[0-9]{4})? +[0-9]{1,2}:[0-9]{2}(:[0-9]{2})?"
+		"( +[A-Z]{2,5}| +[+-][0-9]{4})*( +[0-9]{4})?"), "" });
+	normalizers.push_back({ std::regex(
+		"\\b(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) +"
+		"[0-9]{1,2} +([0-9]{1,2}:[0-9]{2}|[0-9]{4})\\b"), "" });
+	normalizers.push_back({ std::regex(
+		"\\b[0-9]{4}-[0-9]{2}-[0-9]{2}([T ][0-9]{2}:[0-9]{2}"
+		"(:[0-9]{2}(\\.[0-9]+)?)?(Z|[+-][0-9]{2}:?[0-9]{2})?)?"), "" });
+	normalizers.push_back({ std::regex(
+		"\\b[0-9]{1,2}:[0-9]{2}:[0-9]{2}\\b"), "" });
+
+	/* The hostname, both fully qualified and short. */
+	if (gethostname(hostname, sizeof(hostname)) == 0) {
+		hostname[sizeof(hostname) - 1] = '\0';
+		name = hostname;
+		normalizers.push_back({ std::regex("\\b" + Escape(name) + "\\b"),
+					"[A-Za-z0-9.-]+" });
+		if (name.find('.') != std::string::npos) {
+			name.erase(name.find('.'));
+			normalizers.push_back({ std::regex("\\b" + Escape(name) + "\\b"),
+						"[A-Za-z0-9.-]+" });
+		}
+	}
+
+	/* Paths inside the sandbox directories, which differ between runs. */
+	if (realpath(utils::tmpdir, path) != NULL) {
+		normalizers.push_back({ std::regex(Escape(path) + "(/[^ ]*)?"),
+					"/[^ ]*" });
+	}
+
+	return normalizers;
+}
+
+/*
+ * Adds "segment", unless it is contained in one of "segments". Segments
+ * which partially overlap are merged into one which matches anything.
+ */
+static void
+AddSegment(std::vector<Segment>& segments, Segment segment)
+{
+	for (auto it = segments.begin(); it != segments.end();) {
+		if (it->begin <= segment.begin && segment.end <= it->end)
+			return;
+		if (it->begin < segment.end && segment.begin < it->end) {
+			segment.begin = std::min(segment.begin, it->begin);
+			segment.end = std::max(segment.end, it->end);
+			segment.pattern = ANY;
+			it = segments.erase(it);
+		} else {
+			it++;
+		}
+	}
+	segments.push_back(segment);
+}
+
+/* Builds the pattern for "line" with "segments" replaced. */
+static std::string
+Pattern(std::string_view line, std::vector<Segment>& segments)
+{
+	std::string pattern = "^";
+	size_t pos = 0;
+
+	std::sort(segments.begin(), segments.end(),
+		  [](const Segment& a, const Segment& b) { return a.begin < b.begin; });
+	for (const auto &segment : segments) {
+		pattern += Escape(line.substr(pos, segment.begin - pos));
+		pattern += segment.pattern;
+		pos = segment.end;
+	}
+	pattern += Escape(line.substr(pos));
+	return pattern + "$";
+}
+
+/* Returns whether "pattern" matches "line" and each of its "variants". */
+static bool
+Matches(std::string pattern,
+	std::string_view line,
+	const std::vector<std::string_view>& variants)
+{
+	std::regex regex(pattern, std::regex::extended);
+
+	if (!std::regex_search(line.begin(), line.end(), regex))
+		return false;
+	for (const auto &variant : variants) {
+		if (!std::regex_search(variant.begin(), variant.end(), regex))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Returns the pattern for a line of output, given the same line as produced
+ * by the repeated executions, or an empty string if the line is checked as
+ * is.
+ */
+static std::string
+NormalizeLine(std::string_view line,
+	      const std::vector<std::string_view>& variants)
+{
+	static const std::vector<Normalizer> normalizers = Compile();
+	std::vector<Segment> segments;
+	std::string pattern;
+	std::string text(line);
+
+	for (const auto &normalizer : normalizers) {
+		for (auto it = std::sregex_iterator(text.begin(), text.end(),
+						    normalizer.regex);
+		     it != std::sregex_iterator(); it++) {
+			if (it->length() == 0)
+				continue;
+			AddSegment(segments, { (size_t)it->position(),
+				   (size_t)(it->position() + it->length()),
+				   normalizer.pattern.empty() ?
+				   Shape(it->str()) : normalizer.pattern });
+		}
+	}
+
+	/* Byte ranges differing from the repeated executions, in whole words. */
+	for (const auto &variant : variants) {
+		size_t prefix = 0;
+		size_t suffix = 0;
+
+		if (variant == line)
+			continue;
+		while (prefix < line.size() && prefix < variant.size() &&
+		       line[prefix] == variant[prefix])
+			prefix++;
+		while (suffix < line.size() - prefix &&
+		       suffix < variant.size() - prefix &&
+		       line[line.size() - suffix - 1] ==
+		       variant[variant.size() - suffix - 1])
+			suffix++;
+		size_t begin = prefix;
+		size_t end = line.size() - suffix;
+		while (begin > 0 && isalnum((unsigned char)line[begin - 1]))
+			begin--;
+		while (end < line.size() && isalnum((unsigned char)line[end]))
+			end++;
+		AddSegment(segments, { begin, end, begin == end ?
+			   ANY : Shape(line.substr(begin, end - begin)) });
+	}
+
+	if (segments.empty())
+		return "";
+	if (Matches(pattern = Pattern(line, segments), line, variants))
+		return pattern;
+	/* A shape did not fit, fall back to matching anything in its place. */
+	for (auto &segment : segments)
+		segment.pattern = ANY;
+	if (Matches(pattern = Pattern(line, segments), line, variants))
+		return pattern;
+	return "^" ANY "$";
+}
+
+/* Splits "output" into lines, without the trailing newline. */
+static std::vector<std::string_view>
+Lines(std::string_view output)
+{
+	std::vector<std::string_view> lines;
+	size_t pos = 0;
+	size_t next;
+
+	while (pos < output.size()) {
+		if ((next = output.find('\n', pos)) == std::string_view::npos)
+			next = output.size();
+		lines.push_back(output.substr(pos, next - pos));
+		pos = next + 1;
+	}
+	return lines;
+}
+
+/*
+ * Computes the patterns the lines of "output" are checked against, given the
+ * output of the "repeated" executions of the same command. Returns false if
+ * the output is deterministic, i.e. it should be checked as is. Otherwise,
+ * "patterns" holds one (anchored) pattern for every distinct line, which is
+ * empty if even the number of lines differs between the executions.
+ */
+bool
+normalize::Normalize(std::string_view output,
+		     const std::vector<outputstore::Output>& repeated,
+		     std::vector<std::string>& patterns)
+{
+	std::vector<std::string_view> lines = Lines(output);
+	std::vector<std::vector<std::string_view>> variants(lines.size());
+	std::vector<std::string_view> repeated_lines;
+	std::string pattern;
+	bool nondeterministic = false;
+
+	patterns.clear();
+	if (repeated.empty())
+		return false;
+
+	for (const auto &it : repeated) {
+		repeated_lines = Lines(it);
+		if (repeated_lines.size() != lines.size())
+			return true;
+		for (size_t i = 0; i < lines.size(); i++)
+			variants[i].push_back(repeated_lines[i]);
+	}
+
+	for (size_t i = 0; i < lines.size(); i++) {
+		if ((pattern = NormalizeLine(lines[i], variants[i])).empty())
+			pattern = "^" + Escape(lines[i]) + "$";
+		else
+			nondeterministic = true;
+		if (std::find(patterns.begin(), patterns.end(), pattern) ==
+		    patterns.end())
+			patterns.push_back(pattern);
+	}
+
+	if (!nondeterministic)
+		patterns.clear();
+	return nondeterministic;
+}
+
+/* Quotes "pattern" for placing it inside double quotes in a script. */
+std::string
+normalize::Quote(std::string_view pattern)
+{
+	std::string quoted;
+
+	for (const auto &c : pattern) {
+		if (c == '\\' || c == '"' || c == '$' || c == '`')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted;
+}
@@ -0,0 +1,54 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _NORMALIZE_H_
+#define _NORMALIZE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "output_store.h"
+
+/*
+ * Normalization of nondeterministic output. Every command is executed
+ * "utils::repeat" times concurrently, and the byte ranges which differ
+ * between the executions (along with the parts which are bound to differ
+ * between runs or hosts, i.e. timestamps, the hostname and the paths of the
+ * sandbox directories) are replaced by regular expressions, so that the
+ * generated tests check the output via atf-check(1)'s "match:" instead of a
+ * brittle "inline:".
+ */
+namespace normalize {
+	bool Normalize(std::string_view,
+		       const std::vector<outputstore::Output>&,
+		       std::vector<std::string>&);
+	std::string Quote(std::string_view);
+}
+
+#endif  /* _NORMALIZE_H_ */
@@ -0,0 +1,225 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _OPTION_CATALOG_H_
+#define _OPTION_CATALOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+/*
+ * Catalog of the options with a well-known meaning, which can be easily
+ * tested. An option accepted by a utility is identified as such if the
+ * keyword of its meaning appears in its description. The catalog (along with
+ * a perfect hash of the option names) is built at compile time, hence
+ * looking up an option involves a single probe of a constant table.
+ */
+namespace optcatalog {
+	/* Meaning of an option, named by the keyword in "keywords". */
+	enum Keyword {
+		HELP,
+		VERSION,
+		VERBOSE,
+		QUIET,
+		RECURSIVE,
+		NUL_TERMINATED
+	};
+
+	/*
+	 * Keywords looked up in the descriptions, indexed by Keyword. The i'th
+	 * one corresponds to the i'th bit of optionindex::Option::keywords.
+	 */
+	constexpr std::string_view keywords[] = {
+		"help", "version", "verbose", "quiet", "recursive", "NUL"
+	};
+
+	/* Option relation, which maps an option name to its meaning. */
+	struct Relation {
+		char type;               /* Option type: (s)short/(l)long. */
+		std::string_view value;  /* Name of the option. */
+		Keyword keyword;
+	};
+
+	/* Relations of the same option (e.g. "-v") are adjacent. */
+	constexpr Relation catalog[] = {
+		{ 's', "h",          HELP },
+		{ 'l', "-help",      HELP },
+		{ 's', "v",          VERSION },
+		{ 's', "v",          VERBOSE },
+		{ 's', "V",          VERSION },
+		{ 'l', "-version",   VERSION },
+		{ 'l', "-verbose",   VERBOSE },
+		{ 's', "q",          QUIET },
+		{ 'l', "-quiet",     QUIET },
+		{ 'l', "-silent",    QUIET },
+		{ 's', "r",          RECURSIVE },
+		{ 's', "R",          RECURSIVE },
+		{ 'l', "-recursive", RECURSIVE },
+		{ 's', "0",          NUL_TERMINATED },
+		{ 's', "z",          NUL_TERMINATED },
+		{ 'l', "-null",      NUL_TERMINATED }
+	};
+
+	/* Index of a relation in "catalog". */
+	typedef uint8_t Index;
+
+	constexpr size_t CATALOG_SIZE = sizeof(catalog) / sizeof(catalog[0]);
+	/* The hash table has 2^SLOT_BITS slots. */
+	constexpr size_t SLOT_BITS = 5;
+	constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+	static_assert(sizeof(keywords) / sizeof(keywords[0]) <= 32,
+		      "keywords do not fit in a bitmask");
+	static_assert(CATALOG_SIZE < 255 && CATALOG_SIZE <= SLOTS,
+		      "catalog does not fit in the hash table");
+
+	/*
+	 * 32-bit FNV-1a hash of "name", starting from "seed", followed by a
+	 * final mix so that every bit depends on all the characters.
+	 */
+	constexpr uint32_t
+	Hash(std::string_view name, uint32_t seed)
+	{
+		uint32_t hash = 0x811c9dc5 ^ seed;
+
+		for (const auto &c : name) {
+			hash ^= (unsigned char)c;
+			hash *= 0x01000193;
+		}
+		hash ^= hash >> 16;
+		hash *= 0x85ebca6b;
+		return hash ^ (hash >> 13);
+	}
+
+	/* Slot of "name", taken from the upper bits of its hash. */
+	constexpr size_t
+	Slot(std::string_view name, uint32_t seed)
+	{
+		return Hash(name, seed) >> (32 - SLOT_BITS);
+	}
+
+	/* Returns whether "seed" hashes the distinct names to distinct slots. */
+	constexpr bool
+	Perfect(uint32_t seed)
+	{
+		for (size_t i = 0; i < CATALOG_SIZE; i++) {
+			for (size_t j = i + 1; j < CATALOG_SIZE; j++) {
+				if (catalog[i].value != catalog[j].value &&
+				    Slot(catalog[i].value, seed) ==
+				    Slot(catalog[j].value, seed))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	/* Returns the first seed yielding a perfect hash. */
+	constexpr uint32_t
+	FindSeed()
+	{
+		uint32_t seed = 0;
+
+		while (!Perfect(seed))
+			seed++;
+		return seed;
+	}
+
+	constexpr uint32_t seed = FindSeed();
+
+	/* Slot of a name, holding its first relation (or 0xff if empty). */
+	struct Table {
+		Index slots[SLOTS];
+	};
+
+	constexpr Table
+	BuildTable()
+	{
+		Table table = {};
+
+		for (size_t i = 0; i < SLOTS; i++)
+			table.slots[i] = 0xff;
+		for (size_t i = CATALOG_SIZE; i-- > 0;)
+			table.slots[Slot(catalog[i].value, seed)] = i;
+		return table;
+	}
+
+	constexpr Table table = BuildTable();
+
+	/*
+	 * Returns the index of the first relation of the option "name", or
+	 * CATALOG_SIZE if it is not present in the catalog.
+	 */
+	constexpr size_t
+	Find(std::string_view name)
+	{
+		Index i = table.slots[Slot(name, seed)];
+
+		if (i == 0xff || catalog[i].value != name)
+			return CATALOG_SIZE;
+		return i;
+	}
+
+	/*
+	 * Returns the index of the relation of the option "name" whose keyword
+	 * is present in "keywords" (a bitmask, see "keywords"), or CATALOG_SIZE
+	 * if there is none.
+	 */
+	constexpr size_t
+	Classify(std::string_view name, uint32_t keywords)
+	{
+		for (size_t i = Find(name);
+		     i < CATALOG_SIZE && catalog[i].value == name; i++) {
+			if (keywords & (1U << catalog[i].keyword))
+				return i;
+		}
+		return CATALOG_SIZE;
+	}
+
+	/* Returns whether the relations of every option are adjacent. */
+	constexpr bool
+	Adjacent()
+	{
+		for (size_t i = 0; i < CATALOG_SIZE; i++) {
+			for (size_t j = i + 2; j < CATALOG_SIZE; j++) {
+				if (catalog[i].value == catalog[j].value &&
+				    catalog[j - 1].value != catalog[j].value)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static_assert(Adjacent(), "relations of an option are not adjacent");
+	static_assert(Find("v") == 2 && Find("-null") == CATALOG_SIZE - 1 &&
+		      Find("x") == CATALOG_SIZE, "broken perfect hash");
+	static_assert(Classify("v", 1U << VERBOSE) == 3, "broken catalog");
+}
+
+#endif  /* _OPTION_CATALOG_H_ */
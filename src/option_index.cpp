@@ -0,0 +1,336 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string_view>
+
+#include "fetch_groff.h"
+#include "logging.h"
+#include "option_catalog.h"
+#include "option_index.h"
+#include "utils.h"
+
+/* Identifies an index file, along with the version of its format. */
+#define INDEX_MAGIC "SMKIDX2"
+
+using optionindex::IndexHeader;
+using optionindex::IndexRecord;
+using optionindex::IndexOption;
+
+std::string optionindex::indexfile = "option_index";
+
+/* Entry of a utility, either loaded from the index or collected in this run. */
+struct Entry {
+	int64_t mtime;
+	uint64_t size;
+	uint64_t hash;
+	std::vector<optionindex::Option> options;
+};
+
+/* The index loaded at startup, mapped in memory. */
+static const char *index_data = NULL;
+static const IndexHeader *header;
+static const IndexRecord *records;
+static const IndexOption *options;
+static const char *strings;
+static uint64_t fingerprint;  /* Of the keywords known to the tool. */
+
+/*
+ * Entries collected in this run, written out by Save(). They are kept
+ * around, so that the entries of the man pages which changed during a run
+ * with "--watch" are looked up in memory.
+ */
+static std::mutex update_lock;
+static std::map<std::string, Entry> updates;
+static bool dirty;  /* Whether "updates" changed since the last Save(). */
+
+static bool
+StatManpage(std::string manpage, int64_t& mtime, uint64_t& size)
+{
+	struct stat sb;
+
+	if (stat(manpage.c_str(), &sb) < 0)
+		return false;
+	mtime = (int64_t)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+	size = sb.st_size;
+
+	return true;
+}
+
+static std::string_view
+String(uint32_t offset, uint32_t len)
+{
+	if ((uint64_t)offset + len > header->strings)
+		return std::string_view();
+	return std::string_view(strings + offset, len);
+}
+
+/* Binary searches the (sorted) records for "utility". */
+static const IndexRecord *
+FindRecord(std::string utility)
+{
+	const IndexRecord *end = records + header->count;
+	const IndexRecord *it;
+
+	it = std::lower_bound(records, end, utility,
+		[](const IndexRecord& record, const std::string& name) {
+			return String(record.name, record.name_len) < name;
+		});
+	if (it == end || String(it->name, it->name_len) != utility)
+		return NULL;
+	return it;
+}
+
+/* Copies the options of "record" to "list", returns false if corrupted. */
+static bool
+ReadOptions(const IndexRecord *record, std::vector<optionindex::Option>& list)
+{
+	list.clear();
+	if ((uint64_t)record->first + record->count > header->noptions)
+		return false;
+	for (uint32_t i = record->first; i < record->first + record->count; i++) {
+		std::string_view name = String(options[i].name,
+					       options[i].name_len);
+		if (name.empty() || options[i].arg > mdoc::ARG_OPTIONAL)
+			return false;
+		list.push_back({std::string(name),
+				(mdoc::ArgKind)options[i].arg,
+				options[i].keywords,
+				options[i].group,
+				options[i].forms});
+	}
+
+	return true;
+}
+
+/*
+ * Maps the index in memory. The index is ignored if it was built with a
+ * different set of keywords (see option_catalog.h).
+ */
+void
+optionindex::Load()
+{
+	struct stat sb;
+	void *addr;
+	size_t expected;
+	int fd;
+
+	fingerprint = utils::Hash64(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	for (const auto &keyword : optcatalog::keywords) {
+		fingerprint = utils::Hash64(keyword.data(), keyword.size(),
+					    fingerprint);
+		fingerprint = utils::Hash64("", 1, fingerprint);
+	}
+
+	if ((fd = open(indexfile.c_str(), O_RDONLY)) < 0)
+		return;  /* Built at the end of this run. */
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(IndexHeader)) {
+		close(fd);
+		return;
+	}
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		logging::LogPerror("mmap()");
+		return;
+	}
+
+	header = (const IndexHeader *)addr;
+	expected = sizeof(IndexHeader)
+		 + (size_t)header->count * sizeof(IndexRecord)
+		 + (size_t)header->noptions * sizeof(IndexOption)
+		 + header->strings;
+	if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) ||
+	    header->fingerprint != fingerprint ||
+	    expected != (size_t)sb.st_size) {
+		/* Stale or corrupted, rebuild it. */
+		munmap(addr, sb.st_size);
+		return;
+	}
+
+	index_data = (const char *)addr;
+	records = (const IndexRecord *)(index_data + sizeof(IndexHeader));
+	options = (const IndexOption *)(records + header->count);
+	strings = (const char *)(options + header->noptions);
+}
+
+/*
+ * Retrieves the options of "utility" from the index, provided that its man
+ * page "manpage" is unchanged since the index was built (or since its
+ * options were last updated). A man page whose modification time differs is
+ * compared by its contents.
+ */
+bool
+optionindex::Lookup(std::string utility, std::string manpage,
+		    std::vector<Option>& list)
+{
+	const IndexRecord *record;
+	int64_t mtime;
+	uint64_t size;
+
+	if (!StatManpage(manpage, mtime, size))
+		return false;
+	{
+		std::lock_guard<std::mutex> guard(update_lock);
+		auto it = updates.find(utility);
+		if (it != updates.end() && it->second.mtime == mtime &&
+		    it->second.size == size) {
+			list = it->second.options;
+			return true;
+		}
+	}
+
+	if (index_data == NULL || (record = FindRecord(utility)) == NULL)
+		return false;
+	if (record->size != size)
+		return false;
+	if (record->mtime != mtime && utils::HashFile(manpage) != record->hash)
+		return false;
+	if (!ReadOptions(record, list))
+		return false;
+
+	/* The man page was touched, record its new modification time. */
+	if (record->mtime != mtime)
+		Update(utility, manpage, list);
+
+	return true;
+}
+
+/* Records the options of "utility", as collected from "manpage". */
+void
+optionindex::Update(std::string utility, std::string manpage,
+		    const std::vector<Option>& list)
+{
+	Entry entry;
+
+	if (!StatManpage(manpage, entry.mtime, entry.size))
+		return;
+	entry.hash = utils::HashFile(manpage);
+	entry.options = list;
+
+	std::lock_guard<std::mutex> guard(update_lock);
+	updates[utility] = std::move(entry);
+	dirty = true;
+}
+
+/*
+ * Writes the index atomically if any entry was updated since the last call.
+ * Entries of the utilities which are no longer present in the src tree are
+ * dropped.
+ */
+void
+optionindex::Save()
+{
+	std::lock_guard<std::mutex> guard(update_lock);
+	std::map<std::string, Entry> entries;
+	std::string buffer;
+	std::string table;  /* String table. */
+	IndexHeader new_header;
+	IndexRecord record;
+	IndexOption option;
+	uint32_t noptions = 0;
+
+	if (!dirty)
+		return;
+	dirty = false;
+
+	for (uint32_t i = 0; index_data != NULL && i < header->count; i++) {
+		std::string utility(String(records[i].name, records[i].name_len));
+		Entry entry;
+
+		if (updates.find(utility) != updates.end() ||
+		    groff::groff_map.find(utility) == groff::groff_map.end())
+			continue;
+		if (!ReadOptions(&records[i], entry.options))
+			continue;
+		entry.mtime = records[i].mtime;
+		entry.size = records[i].size;
+		entry.hash = records[i].hash;
+		entries[utility] = std::move(entry);
+	}
+	for (auto &it : updates)
+		entries[it.first] = it.second;
+
+	for (const auto &it : entries)
+		noptions += it.second.options.size();
+	memset(&new_header, 0, sizeof(new_header));
+	memcpy(new_header.magic, INDEX_MAGIC, sizeof(new_header.magic));
+	new_header.count = entries.size();
+	new_header.noptions = noptions;
+	new_header.fingerprint = fingerprint;
+
+	buffer.reserve(sizeof(IndexHeader)
+		       + entries.size() * sizeof(IndexRecord)
+		       + noptions * sizeof(IndexOption));
+	buffer.append(sizeof(IndexHeader), '\0');
+
+	/* Records, followed by the options. */
+	noptions = 0;
+	for (const auto &it : entries) {
+		memset(&record, 0, sizeof(record));
+		record.name = table.size();
+		record.name_len = it.first.size();
+		record.first = noptions;
+		record.count = it.second.options.size();
+		record.mtime = it.second.mtime;
+		record.size = it.second.size;
+		record.hash = it.second.hash;
+		buffer.append((const char *)&record, sizeof(record));
+		table.append(it.first);
+		noptions += record.count;
+	}
+	for (const auto &it : entries) {
+		for (const auto &opt : it.second.options) {
+			memset(&option, 0, sizeof(option));
+			option.name = table.size();
+			option.name_len = opt.name.size();
+			option.arg = opt.arg;
+			option.keywords = opt.keywords;
+			option.group = opt.group;
+			option.forms = opt.forms;
+			buffer.append((const char *)&option, sizeof(option));
+			table.append(opt.name);
+		}
+	}
+
+	new_header.strings = table.size();
+	memcpy(&buffer[0], &new_header, sizeof(new_header));
+	buffer.append(table);
+
+	if (!utils::WriteFileAtomic(indexfile, buffer))
+		std::cerr << "Unable to write option index: " << indexfile << "\n";
+}
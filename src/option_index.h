@@ -0,0 +1,101 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _OPTION_INDEX_H_
+#define _OPTION_INDEX_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "mdoc.h"
+
+/*
+ * The option index is a binary file holding the options accepted by every
+ * utility, as collected from its man page. It is laid out as follows (all
+ * the integers are in host byte order):
+ *
+ * 	IndexHeader
+ * 	IndexRecord[count]      sorted by the name of the utility
+ * 	IndexOption[noptions]   options of every record, contiguous
+ * 	char[]                  names of the utilities and the options
+ *
+ * An option records which keywords (of the option catalog, see
+ * option_catalog.h) appear in its description as a bitmask, the i'th bit
+ * corresponding to the i'th keyword. The index is invalidated as a whole
+ * when this set of keywords changes, and per utility when its man page
+ * changes.
+ */
+namespace optionindex {
+	struct IndexHeader {
+		char magic[8];         /* INDEX_MAGIC */
+		uint32_t count;        /* Number of records. */
+		uint32_t noptions;     /* Number of options (of all the records). */
+		uint64_t fingerprint;  /* Hash of the keywords. */
+		uint64_t strings;      /* Size of the string table. */
+	};
+
+	struct IndexRecord {
+		uint32_t name;         /* Offset in the string table. */
+		uint32_t name_len;
+		uint32_t first;        /* Index of the first option. */
+		uint32_t count;        /* Number of options. */
+		int64_t mtime;         /* Of the man page (nanoseconds). */
+		uint64_t size;         /* Of the man page. */
+		uint64_t hash;         /* Of the contents of the man page. */
+	};
+
+	struct IndexOption {
+		uint32_t name;         /* Offset in the string table. */
+		uint16_t name_len;
+		uint8_t arg;           /* mdoc::ArgKind */
+		uint8_t reserved;
+		uint32_t keywords;     /* Keywords present in the description. */
+		uint16_t group;        /* See mdoc::Option. */
+		uint16_t forms;        /* See mdoc::Option. */
+	};
+
+	/* An option accepted by a utility, in order of appearance. */
+	struct Option {
+		std::string name;
+		mdoc::ArgKind arg;
+		uint32_t keywords;
+		uint16_t group;
+		uint16_t forms;
+	};
+
+	extern std::string indexfile;
+
+	void Load();
+	bool Lookup(std::string, std::string, std::vector<Option>&);
+	void Update(std::string, std::string, const std::vector<Option>&);
+	void Save();
+}
+
+#endif  /* _OPTION_INDEX_H_ */
@@ -0,0 +1,171 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <string.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "output_store.h"
+#include "utils.h"
+
+/*
+ * The store is split into shards (picked by the hash of an output), so that
+ * the executors of concurrent workers rarely contend on a lock.
+ */
+#define SHARDS 16
+/* Outputs are copied into chunks of this size, larger ones get their own. */
+#define CHUNK_SIZE (256 * 1024)
+
+struct outputstore::Entry {
+	uint64_t hash;
+	std::string_view text;  /* Inside a chunk of the shard. */
+	const Entry *next;      /* Next entry with the same hash. */
+};
+
+struct Shard {
+	std::mutex lock;
+	std::unordered_map<uint64_t, const outputstore::Entry *> index;
+	std::deque<outputstore::Entry> entries;  /* Stable addresses. */
+	std::vector<std::unique_ptr<char[]>> chunks;
+	size_t used;   /* Bytes used in the last chunk. */
+};
+
+static Shard shards[SHARDS];
+static const outputstore::Entry empty_entry = { utils::Hash64(NULL, 0), {}, NULL };
+
+/* Copies "text" into the arena of "shard". */
+static std::string_view
+Copy(Shard& shard, std::string_view text)
+{
+	char *data;
+
+	if (text.size() > CHUNK_SIZE / 4) {
+		shard.chunks.insert(shard.chunks.begin(),
+				    std::make_unique<char[]>(text.size()));
+		data = shard.chunks.front().get();
+	} else {
+		if (shard.chunks.empty() || shard.used + text.size() > CHUNK_SIZE) {
+			shard.chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+			shard.used = 0;
+		}
+		data = shard.chunks.back().get() + shard.used;
+		shard.used += text.size();
+	}
+	memcpy(data, text.data(), text.size());
+
+	return std::string_view(data, text.size());
+}
+
+outputstore::Output::Output() : entry(&empty_entry)
+{
+}
+
+/* Stores "text", unless an equal output is already stored. */
+outputstore::Output::Output(std::string_view text)
+{
+	uint64_t hash;
+
+	if (text.empty()) {
+		entry = &empty_entry;
+		return;
+	}
+
+	hash = utils::Hash64(text.data(), text.size());
+	Shard& shard = shards[hash % SHARDS];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	const Entry *&head = shard.index[hash];
+
+	for (entry = head; entry != NULL; entry = entry->next) {
+		if (entry->text == text)
+			return;
+	}
+	shard.entries.push_back({ hash, Copy(shard, text), head });
+	entry = head = &shard.entries.back();
+}
+
+std::string_view
+outputstore::Output::view() const
+{
+	return entry->text;
+}
+
+outputstore::Output::operator std::string_view() const
+{
+	return entry->text;
+}
+
+bool
+outputstore::Output::empty() const
+{
+	return entry->text.empty();
+}
+
+size_t
+outputstore::Output::size() const
+{
+	return entry->text.size();
+}
+
+uint64_t
+outputstore::Output::hash() const
+{
+	return entry->hash;
+}
+
+/* Equal outputs are stored once, hence share the entry. */
+bool
+outputstore::Output::operator==(const Output& other) const
+{
+	return entry == other.entry;
+}
+
+bool
+outputstore::Output::operator!=(const Output& other) const
+{
+	return entry != other.entry;
+}
+
+/*
+ * Releases every stored output, which leaves the handles to them (other than
+ * those of empty outputs) dangling. Must not race with storing an output.
+ */
+void
+outputstore::Clear()
+{
+	for (auto &shard : shards) {
+		std::lock_guard<std::mutex> guard(shard.lock);
+		shard.index.clear();
+		shard.entries.clear();
+		shard.chunks.clear();
+		shard.used = 0;
+	}
+}
@@ -0,0 +1,69 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _OUTPUT_STORE_H_
+#define _OUTPUT_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+/*
+ * Store of the outputs of the executed commands. Every distinct output (e.g.
+ * the usage message a utility prints for each of its invalid options) is
+ * kept once, in an arena shared by all the utilities, and is addressed by a
+ * handle. The outputs are indexed by their 64-bit hash (see utils::Hash64),
+ * and equal outputs share the handle, hence handles are compared in
+ * constant time. The stored outputs live until Clear() is called, once a
+ * round of test generation no longer needs them.
+ */
+namespace outputstore {
+	struct Entry;
+
+	class Output {
+	public:
+		Output();
+		explicit Output(std::string_view);
+
+		std::string_view view() const;
+		operator std::string_view() const;
+		bool empty() const;
+		size_t size() const;
+		uint64_t hash() const;
+		bool operator==(const Output&) const;
+		bool operator!=(const Output&) const;
+
+	private:
+		const Entry *entry;
+	};
+
+	void Clear();
+}
+
+#endif  /* _OUTPUT_STORE_H_ */
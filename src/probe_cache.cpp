@@ -0,0 +1,342 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cinttypes>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "executor.h"
+#include "logging.h"
+#include "probe_cache.h"
+#include "utils.h"
+
+/* Version of the on-disk entry format. */
+#define CACHE_VERSION "5"
+/* File (inside "cachedir") holding the learned response times. */
+#define LATENCY_FILE "latencies"
+/*
+ * A utility is given LATENCY_FACTOR times its slowest observed response
+ * time (but at least MIN_DEADLINE milliseconds) to respond.
+ */
+#define LATENCY_FACTOR 4
+#define MIN_DEADLINE 100
+
+std::string probecache::cachedir = "probe_cache";
+bool probecache::enabled = true;
+unsigned long probecache::max_size = 256UL << 20;
+
+/*
+ * Slowest response time (milliseconds) of every utility, as learned from
+ * the previous runs and (separately) observed in the current run.
+ */
+static std::mutex latency_lock;
+static std::unordered_map<std::string, long> learned_latency;
+static std::unordered_map<std::string, long> observed_latency;
+
+/*
+ * Computes the name of the cache entry for running "command" for "utility".
+ * The key covers the contents of the executable the command resolves to,
+ * the command itself, the number of times it is executed, the limits it is
+ * executed under (including the bounds on its running time and output, which
+ * decide whether its output is truncated), and the environment it is executed
+ * in. The directory it is executed in is left out, since it is merely an empty
+ * sandbox picked from a pool.
+ */
+static std::string
+EntryPath(std::string utility, std::string command)
+{
+	std::string binary = utils::ResolveUtility(utility);
+	uint64_t key = utils::HashFile(binary);
+	char name[17];
+
+	key = utils::Hash64(command.c_str(), command.size() + 1, key);
+	key = utils::Hash64((const char *)&utils::repeat, sizeof(utils::repeat),
+			    key);
+	key = utils::Hash64((const char *)utils::probe_limits,
+			    sizeof(utils::probe_limits), key);
+	key = utils::Hash64((const char *)&executor::max_time,
+			    sizeof(executor::max_time), key);
+	key = utils::Hash64((const char *)&executor::max_output,
+			    sizeof(executor::max_output), key);
+	for (int i = 0; utils::probe_environ[i] != NULL; i++) {
+		key = utils::Hash64(utils::probe_environ[i],
+				    strlen(utils::probe_environ[i]) + 1, key);
+	}
+
+	snprintf(name, sizeof(name), "%016" PRIx64, key);
+	/* Spread the entries over 256 subdirectories. */
+	return probecache::cachedir + "/" + std::string(name, 2) + "/" + name;
+}
+
+/*
+ * Creates the cache directory (and its subdirectories) if absent, and loads
+ * the learned response times.
+ */
+void
+probecache::Init()
+{
+	std::ifstream file;
+	std::string utility;
+	long latency;
+	char subdir[3];
+
+	if (!enabled)
+		return;
+
+	file.open(cachedir + "/" LATENCY_FILE);
+	while (file >> utility >> latency)
+		learned_latency[utility] = latency;
+	file.close();
+
+	try {
+		boost::filesystem::create_directories(cachedir);
+		for (int i = 0; i < 256; i++) {
+			snprintf(subdir, sizeof(subdir), "%02x", i);
+			boost::filesystem::create_directory(cachedir + "/" + subdir);
+		}
+	} catch (const boost::filesystem::filesystem_error& e) {
+		std::cerr << "Unable to create cache directory: " << cachedir
+			  << ", caching disabled\n";
+		enabled = false;
+	}
+}
+
+/*
+ * Returns the time (milliseconds) "utility" is given to respond, based on
+ * its response times in the previous runs. Returns 0 if nothing is known
+ * about the utility, in which case the default timeout applies.
+ */
+long
+probecache::Deadline(std::string utility)
+{
+	std::lock_guard<std::mutex> guard(latency_lock);
+	auto it = learned_latency.find(utility);
+
+	if (it == learned_latency.end())
+		return 0;
+	return std::max(it->second * LATENCY_FACTOR, (long)MIN_DEADLINE);
+}
+
+/*
+ * Records the response time of a command executed for "utility". A command
+ * which timed out under a learned deadline might have been too slow rather
+ * than blocked, hence the learned deadline is dropped so that the next run
+ * starts over with the default timeout.
+ */
+void
+probecache::RecordLatency(std::string utility, long latency, bool timedout)
+{
+	std::lock_guard<std::mutex> guard(latency_lock);
+
+	if (timedout) {
+		if (learned_latency.find(utility) != learned_latency.end())
+			observed_latency[utility] = -1;
+	} else {
+		long& observed = observed_latency[utility];
+		if (observed >= 0)
+			observed = std::max(observed, latency);
+	}
+}
+
+/* Saves the response times observed in the current run. */
+void
+probecache::Flush()
+{
+	std::string data;
+
+	if (!enabled)
+		return;
+
+	std::lock_guard<std::mutex> guard(latency_lock);
+	for (const auto &it : observed_latency) {
+		if (it.second < 0)
+			learned_latency.erase(it.first);
+		else
+			learned_latency[it.first] = it.second;
+	}
+	for (const auto &it : learned_latency)
+		data += it.first + " " + std::to_string(it.second) + "\n";
+	utils::WriteFileAtomic(cachedir + "/" LATENCY_FILE, data);
+}
+
+/*
+ * Looks up the result of running "command" for "utility". Returns true and
+ * populates "result" on a cache hit.
+ */
+bool
+probecache::Lookup(std::string utility,
+		   std::string command,
+		   utils::ProbeResult& result)
+{
+	std::string path;
+	std::string version;
+	std::string cached_command;
+	std::ifstream file;
+	std::string output;
+	std::string error;
+	size_t output_len;
+	size_t error_len;
+	size_t repeated;
+
+	if (!enabled)
+		return false;
+
+	path = EntryPath(utility, command);
+	file.open(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	/*
+	 * Entry format ~
+	 *   <version>\n<command>\n
+	 *   <exit status> <timed out> <truncated> <repeated executions>\n
+	 *   followed by the output of every execution ~
+	 *   <stdout length> <stderr length>\n<stdout><stderr>
+	 * The command is stored to guard against hash collisions.
+	 */
+	if (!std::getline(file, version) || version != CACHE_VERSION ||
+	    !std::getline(file, cached_command) || cached_command != command ||
+	    !(file >> result.exitstatus >> result.timedout >> result.truncated
+		  >> repeated) ||
+	    repeated + 1 != (size_t)utils::repeat || file.get() != '\n')
+		return false;
+
+	result.repeated_output.resize(repeated);
+	result.repeated_error.resize(repeated);
+	for (size_t i = 0; i <= repeated; i++) {
+		if (!(file >> output_len >> error_len) || file.get() != '\n')
+			return false;
+		output.resize(output_len);
+		error.resize(error_len);
+		if (!file.read(&output[0], output_len) ||
+		    !file.read(&error[0], error_len))
+			return false;
+		(i ? result.repeated_output[i - 1] : result.output) =
+			outputstore::Output(output);
+		(i ? result.repeated_error[i - 1] : result.error) =
+			outputstore::Output(error);
+	}
+	result.latency = 0;
+
+	/* Refresh the modification time, which is used for LRU eviction. */
+	utimes(path.c_str(), NULL);
+	return true;
+}
+
+/* Records the result of running "command" for "utility". */
+void
+probecache::Store(std::string utility,
+		  std::string command,
+		  const utils::ProbeResult& result)
+{
+	std::string entry;
+
+	if (!enabled)
+		return;
+
+	entry = CACHE_VERSION "\n" + command + "\n"
+	      + std::to_string(result.exitstatus) + " "
+	      + std::to_string(result.timedout) + " "
+	      + std::to_string(result.truncated) + " "
+	      + std::to_string(result.repeated_output.size()) + "\n";
+	for (size_t i = 0; i <= result.repeated_output.size(); i++) {
+		outputstore::Output output = i ? result.repeated_output[i - 1]
+					       : result.output;
+		outputstore::Output error = i ? result.repeated_error[i - 1]
+					      : result.error;
+
+		entry.append(std::to_string(output.size()) + " "
+			     + std::to_string(error.size()) + "\n");
+		entry.append(output);
+		entry.append(error);
+	}
+	utils::WriteFileAtomic(EntryPath(utility, command), entry);
+}
+
+/*
+ * Removes the least recently used entries until the size of the cache
+ * directory drops below "max_size".
+ */
+void
+probecache::Evict()
+{
+	struct Entry {
+		std::string path;
+		time_t mtime;
+		off_t size;
+	};
+	std::vector<Entry> entries;
+	unsigned long total = 0;
+	struct stat sb;
+	struct dirent *ent;
+	char subdir[3];
+	DIR *dir;
+
+	if (!enabled)
+		return;
+
+	for (int i = 0; i < 256; i++) {
+		snprintf(subdir, sizeof(subdir), "%02x", i);
+		std::string dirpath = cachedir + "/" + subdir;
+
+		if ((dir = opendir(dirpath.c_str())) == NULL)
+			continue;
+		while ((ent = readdir(dir)) != NULL) {
+			if (ent->d_name[0] == '.')
+				continue;
+			std::string path = dirpath + "/" + ent->d_name;
+			if (stat(path.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+				entries.push_back({ path, sb.st_mtime, sb.st_size });
+				total += sb.st_size;
+			}
+		}
+		closedir(dir);
+	}
+
+	if (total <= max_size)
+		return;
+
+	std::sort(entries.begin(), entries.end(),
+		  [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+	for (const auto &entry : entries) {
+		if (total <= max_size)
+			break;
+		if (unlink(entry.path.c_str()) == 0)
+			total -= entry.size;
+	}
+}
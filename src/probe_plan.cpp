@@ -0,0 +1,134 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <algorithm>
+
+#include "executor.h"
+#include "probe_cache.h"
+#include "probe_plan.h"
+
+probeplan::ProbePlan::ProbePlan(std::string utility)
+	: utility(utility)
+{
+}
+
+/*
+ * Registers the command for running the utility with option "opt" (or
+ * without any arguments if "opt" is empty).
+ */
+void
+probeplan::ProbePlan::Add(std::string opt)
+{
+	std::string command = utils::GenerateCommand(utility, opt);
+
+	if (results.find(command) != results.end())
+		return;
+	results[command];
+	commands.push_back(command);
+}
+
+/*
+ * Submits "command" to "executor" "utils::repeat" times, with "deadline"
+ * milliseconds (0 for the default) to respond, merging the results.
+ */
+void
+probeplan::ProbePlan::Submit(executor::Executor& executor,
+			     const std::string& command,
+			     long deadline)
+{
+	/* References to the elements of "results" remain valid. */
+	utils::ProbeResult& result = results[command];
+
+	result = utils::ProbeResult();
+	for (int i = 0; i < utils::repeat; i++) {
+		executor.Submit(command, [this, command, &result, i]
+				(const utils::ProbeResult& output) {
+			if (i == 0) {
+				result.output = output.output;
+				result.error = output.error;
+				result.exitstatus = output.exitstatus;
+			} else {
+				result.repeated_output.push_back(output.output);
+				result.repeated_error.push_back(output.error);
+			}
+			result.timedout |= output.timedout;
+			result.truncated |= output.truncated;
+			result.latency = std::max(result.latency, output.latency);
+			probecache::RecordLatency(utility, output.latency,
+						  output.timedout);
+		}, deadline);
+	}
+}
+
+/*
+ * Executes every command registered since the last call, unless its result
+ * is already present in the probe cache. The commands are executed
+ * concurrently, each of them "utils::repeat" times.
+ *
+ * A command which timed out under a deadline learned from the previous runs
+ * (shorter than the default) might only have been slowed down, e.g. by the
+ * load of the other jobs, hence it is executed again with the default
+ * deadline. The results of the commands which timed out depend on timing,
+ * hence they are not cached.
+ */
+void
+probeplan::ProbePlan::Run()
+{
+	executor::Executor executor;
+	long deadline = probecache::Deadline(utility);
+	std::vector<std::string> executed;
+
+	for (const auto &command : commands) {
+		if (probecache::Lookup(utility, command, results[command]))
+			continue;
+		executed.push_back(command);
+		Submit(executor, command, deadline);
+	}
+	executor.Run();
+
+	if (deadline != 0 && deadline < executor::default_timeout) {
+		for (const auto &command : executed) {
+			if (results[command].timedout)
+				Submit(executor, command, 0);
+		}
+		executor.Run();
+	}
+
+	for (const auto &command : executed) {
+		if (!results[command].timedout)
+			probecache::Store(utility, command, results[command]);
+	}
+	commands.clear();
+}
+
+/* Returns the memoized result of running the utility with option "opt". */
+const utils::ProbeResult&
+probeplan::ProbePlan::Result(std::string opt)
+{
+	return results.at(utils::GenerateCommand(utility, opt));
+}
@@ -0,0 +1,65 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _PROBE_PLAN_H_
+#define _PROBE_PLAN_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "executor.h"
+#include "utils.h"
+
+namespace probeplan {
+	/*
+	 * Set of commands to be executed for a utility. Every stage of test
+	 * generation registers the options it is interested in, the plan then
+	 * executes each unique command exactly once and hands out the
+	 * memoized results.
+	 */
+	class ProbePlan {
+	public:
+		ProbePlan(std::string);
+
+		void Add(std::string);
+		void Run();
+		const utils::ProbeResult& Result(std::string);
+
+	private:
+		std::string utility;
+		/* Unique commands yet to be executed, in order of addition. */
+		std::vector<std::string> commands;
+		/* Map "command" to the result of its execution. */
+		std::unordered_map<std::string, utils::ProbeResult> results;
+
+		void Submit(executor::Executor&, const std::string&, long);
+	};
+}
+
+#endif  /* _PROBE_PLAN_H_ */
@@ -26,33 +26,152 @@
  * $FreeBSD$
  */
 
-#include <fstream>
-#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include "logging.h"
 #include "read_annotations.h"
+#include "utils.h"
+
+#define ANNOTATIONS_DIR "annotations"
+#define ANNOTATIONS_SUFFIX "_test.ant"
+
+/* Slot of the hash table, empty if "hash" is 0. */
+struct Slot {
+	uint64_t hash;
+	size_t utility;             /* Index in "utilities". */
+	std::string_view testcase;  /* Points into the mapped file. */
+};
+
+/* An annotation file mapped in memory. */
+struct Mapping {
+	void *addr;
+	size_t size;
+};
+
+static std::vector<Mapping> mappings;
+static std::vector<std::string> utilities;
+static std::vector<Slot> table;  /* Open addressing, linear probing. */
+static size_t mask;              /* Size of "table" minus one. */
+
+static uint64_t
+Key(std::string_view utility, std::string_view testcase)
+{
+	uint64_t hash;
 
-/* Read the annotation files and skip generation of respective tests. */
+	hash = utils::Hash64(utility.data(), utility.size());
+	hash = utils::Hash64("", 1, hash);
+	hash = utils::Hash64(testcase.data(), testcase.size(), hash);
+	return hash == 0 ? 1 : hash;  /* 0 marks an empty slot. */
+}
+
+/* Path of the annotation file of the given utility. */
+std::string
+annotations::AnnotationFile(std::string utility)
+{
+	return ANNOTATIONS_DIR "/" + utility + ANNOTATIONS_SUFFIX;
+}
+
+/*
+ * Maps every annotation file in memory and indexes its testcases. Annotations
+ * loaded by an earlier call are dropped, which lets "--watch" pick up the
+ * changed files.
+ */
 void
-annotations::read_annotations(std::string utility,
-			      std::unordered_set<std::string>& annotation_set)
+annotations::Load()
 {
-	std::string line;
-	std::ifstream file;
-	file.open("annotations/" + utility + "_test.annot");
-
-	while (getline(file, line)) {
-		/* Add a unique identifier for no_arguments testcase */
-		if (!line.compare(0, 12, "no_arguments"))
-			annotation_set.insert("*");
-		/*
-		 * Add flag value for supported argument testcases. In doing so
-		 * we ignore the "invalid_usage" testcase as it is guaranteed
-		 * to always succeed.
-		 */
-		else if (!line.compare(2, 4, "flag"))
-			annotation_set.insert(line.substr(0, 1));
+	std::vector<Slot> entries;
+	const std::string suffix = ANNOTATIONS_SUFFIX;
+	struct dirent *ent;
+	struct stat sb;
+	size_t capacity = 16;
+	void *addr;
+	DIR *dir;
+	int fd;
+
+	for (const auto &mapping : mappings)
+		munmap(mapping.addr, mapping.size);
+	mappings.clear();
+	utilities.clear();
+	table.clear();
+
+	if ((dir = opendir(ANNOTATIONS_DIR)) == NULL)
+		return;
+	while ((ent = readdir(dir)) != NULL) {
+		std::string name = ent->d_name;
+		std::string path = ANNOTATIONS_DIR "/" + name;
+
+		if (name.size() <= suffix.size() ||
+		    name.compare(name.size() - suffix.size(), suffix.size(), suffix))
+			continue;
+		if ((fd = open(path.c_str(), O_RDONLY | O_CLOEXEC)) < 0)
+			continue;
+		if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+			close(fd);
+			continue;
+		}
+		addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			logging::LogPerror("mmap()");
+			continue;
+		}
+		mappings.push_back({ addr, (size_t)sb.st_size });
+		utilities.push_back(name.substr(0, name.size() - suffix.size()));
+
+		/* A testcase per line, surrounding whitespace is ignored. */
+		std::string_view data((const char *)addr, sb.st_size);
+		while (!data.empty()) {
+			std::string_view line = data.substr(0, data.find('\n'));
+			size_t first = line.find_first_not_of(" \t\r");
+
+			data.remove_prefix(std::min(line.size() + 1, data.size()));
+			if (first == std::string_view::npos)
+				continue;
+			line = line.substr(first, line.find_last_not_of(" \t\r")
+					   - first + 1);
+			entries.push_back({ Key(utilities.back(), line),
+					    utilities.size() - 1, line });
+		}
+	}
+	closedir(dir);
+
+	/* Keep the table at most half full. */
+	while (capacity < 2 * entries.size())
+		capacity <<= 1;
+	table.assign(capacity, Slot{ 0, 0, std::string_view() });
+	mask = capacity - 1;
+	for (const auto &entry : entries) {
+		if (Annotated(utilities[entry.utility], entry.testcase))
+			continue;
+		size_t i = entry.hash & mask;
+		while (table[i].hash != 0)
+			i = (i + 1) & mask;
+		table[i] = entry;
+	}
+}
+
+/* Returns true if "testcase" of the test of "utility" is annotated. */
+bool
+annotations::Annotated(std::string_view utility, std::string_view testcase)
+{
+	uint64_t hash;
+
+	if (table.empty())
+		return false;
+	hash = Key(utility, testcase);
+	for (size_t i = hash & mask; table[i].hash != 0; i = (i + 1) & mask) {
+		if (table[i].hash == hash && table[i].testcase == testcase &&
+		    utilities[table[i].utility] == utility)
+			return true;
 	}
 
-	file.close();
+	return false;
 }
@@ -29,11 +29,24 @@
 #ifndef _READ_ANNOTATIONS_H_
 #define _READ_ANNOTATIONS_H_
 
-#include <unordered_set>
+#include <string>
+#include <string_view>
 
+/*
+ * Annotations mark the testcases which are not to be generated, e.g. as they
+ * failed in an earlier run. The annotations of a utility are listed (one
+ * testcase per line) in "annotations/<utility>_test.ant", the testcase of an
+ * option "<opt>" being named "<opt>_flag" (e.g. "l_flag", or "_version_flag"
+ * for "--version" and "_0_flag" for "-0", see addtestcase::TestcaseName())
+ * and that of running the utility without arguments "no_arguments".
+ *
+ * The annotation files of all the utilities are mapped in memory at once,
+ * and indexed in a single hash table keyed by (utility, testcase).
+ */
 namespace annotations {
-	void read_annotations(std::string, \
-			      std::unordered_set<std::string>&);
+	std::string AnnotationFile(std::string);
+	void Load();
+	bool Annotated(std::string_view, std::string_view);
 }
 
 #endif  /* _READ_ANNOTATIONS_H_ */
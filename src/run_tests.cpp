@@ -0,0 +1,223 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+#include "executor.h"
+#include "run_tests.h"
+#include "utils.h"
+
+#define ATF_SH "/usr/libexec/atf-sh"
+#define LIST_TIMEOUT 10      /* Seconds for listing the testcases. */
+/* Seconds for running a testcase without a "timeout" property. */
+#define DEFAULT_TIMEOUT 300
+
+/* A testcase along with its result, e.g. "passed" or "failed: <reason>". */
+struct Testcase {
+	std::string test;
+	std::string name;
+	std::string result;
+};
+
+/*
+ * Parses the output of "<test> -l", i.e. a header followed by the properties
+ * of every testcase. Collects the testcases along with their timeouts.
+ */
+static bool
+ParseList(std::string_view output,
+	  std::vector<std::pair<std::string, long>>& testcases)
+{
+	std::istringstream list{std::string(output)};
+	std::string line;
+	long timeout;
+
+	if (!std::getline(list, line) || line.compare(0, 13, "Content-Type:"))
+		return false;
+	while (std::getline(list, line)) {
+		if (!line.compare(0, 7, "ident: ")) {
+			testcases.push_back({ line.substr(7), DEFAULT_TIMEOUT });
+		} else if (!line.compare(0, 9, "timeout: ") && !testcases.empty()) {
+			if ((timeout = atol(line.c_str() + 9)) > 0)
+				testcases.back().second = timeout;
+		}
+	}
+
+	return !testcases.empty();
+}
+
+/* Reads the result of a testcase from the result file written by atf-sh. */
+static std::string
+Result(const utils::ProbeResult& output, std::string resfile)
+{
+	std::ifstream file(resfile);
+	std::string result;
+
+	if (output.timedout)
+		return "broken: Test case body timed out";
+	if (!std::getline(file, result) || result.empty()) {
+		return "broken: Premature exit; test case exited with code "
+		     + std::to_string(output.exitstatus);
+	}
+
+	return result;
+}
+
+/* Returns the paths of the tests to run, all the generated ones by default. */
+static std::vector<std::string>
+Tests(std::string testsdir, const std::vector<std::string>& names)
+{
+	const std::string suffix = "_test.sh";
+	std::vector<std::string> tests;
+	boost::system::error_code error;
+
+	for (const auto &name : names) {
+		if (name.find('/') != std::string::npos)
+			tests.push_back(name);
+		else
+			tests.push_back(testsdir + "/" + name + suffix);
+	}
+	if (!names.empty())
+		return tests;
+
+	boost::filesystem::directory_iterator it(testsdir, error), end;
+	for (; !error && it != end; it.increment(error)) {
+		std::string file = it->path().filename().string();
+		if (file.size() > suffix.size() &&
+		    !file.compare(file.size() - suffix.size(), suffix.size(), suffix))
+			tests.push_back(it->path().string());
+	}
+	std::sort(tests.begin(), tests.end());
+
+	return tests;
+}
+
+/*
+ * Runs the tests under "testsdir" (or the tests of the utilities in "names"),
+ * executing up to "jobs" testcases concurrently. Returns EXIT_SUCCESS if
+ * none of the testcases failed or broke.
+ */
+int
+runtests::RunTests(std::string testsdir, const std::vector<std::string>& names,
+		   int jobs)
+{
+	static const std::pair<const char*, const char*> sections[] = {
+		{ "skipped", "Skipped tests" },
+		{ "expected_", "Expected failures" },
+		{ "broken", "Broken tests" },
+		{ "failed", "Failed tests" },
+	};
+	std::deque<Testcase> results;  /* References remain valid. */
+	std::vector<size_t> counts(sizeof(sections) / sizeof(sections[0]));
+	executor::Executor executor(jobs, executor::TEST);
+	std::chrono::steady_clock::time_point start;
+	std::string resdir;
+	double elapsed;
+	int next = 0;  /* Name of the next result file. */
+
+	if (access(ATF_SH, X_OK) < 0) {
+		std::cerr << "Unable to run the tests, " ATF_SH " not found\n";
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * The testcases are executed inside the sandboxes, hence the paths
+	 * passed to them need to be absolute.
+	 */
+	resdir = boost::filesystem::absolute(utils::tmpdir).string() + "/results";
+	boost::filesystem::create_directories(resdir);
+
+	start = std::chrono::steady_clock::now();
+	for (auto test : Tests(testsdir, names)) {
+		std::string name = boost::filesystem::path(test).stem().string();
+
+		test = boost::filesystem::absolute(test).string();
+		executor.Submit(ATF_SH " " + test + " -l",
+				[&, test, name](const utils::ProbeResult& output) {
+			std::vector<std::pair<std::string, long>> testcases;
+
+			if (output.timedout || output.exitstatus ||
+			    !ParseList(output.output, testcases)) {
+				results.push_back({ name, "__test_cases_list__",
+						    "broken: Unable to list the testcases" });
+				return;
+			}
+			for (const auto &testcase : testcases) {
+				std::string resfile = resdir + "/" + std::to_string(next++);
+
+				results.push_back({ name, testcase.first, "" });
+				Testcase& result = results.back();
+				executor.Submit(ATF_SH " " + test + " -r " + resfile
+						+ " " + testcase.first,
+						[&result, resfile]
+						(const utils::ProbeResult& output) {
+					result.result = Result(output, resfile);
+				}, testcase.second * 1000);
+			}
+		}, LIST_TIMEOUT * 1000);
+	}
+	executor.Run();
+	elapsed = std::chrono::duration<double>
+		(std::chrono::steady_clock::now() - start).count();
+
+	/* Testcases of a test are kept in the order they are listed. */
+	std::stable_sort(results.begin(), results.end(),
+			 [](const Testcase& a, const Testcase& b) {
+				 return a.test < b.test;
+			 });
+	for (size_t i = 0; i < counts.size(); i++) {
+		std::string prefix = sections[i].first;
+
+		for (const auto &testcase : results) {
+			if (testcase.result.compare(0, prefix.size(), prefix))
+				continue;
+			if (counts[i]++ == 0)
+				std::cout << "===> " << sections[i].second << "\n";
+			std::cout << testcase.test << ":" << testcase.name
+				  << "  ->  " << testcase.result << "\n";
+		}
+	}
+	std::cout << "===> Summary\n"
+		  << "Test cases: " << results.size() << " total, "
+		  << counts[0] << " skipped, " << counts[1] << " expected failures, "
+		  << counts[2] << " broken, " << counts[3] << " failed\n"
+		  << "Total time: " << std::fixed << std::setprecision(3)
+		  << elapsed << "s\n";
+
+	return counts[2] + counts[3] ? EXIT_FAILURE : EXIT_SUCCESS;
+}
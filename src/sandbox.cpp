@@ -0,0 +1,136 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <dirent.h>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sandbox.h"
+#include "utils.h"
+
+static std::mutex pool_lock;
+static std::vector<std::string> pool;  /* Empty directories. */
+static int created;                    /* Number of directories created. */
+
+/* Creates a new directory inside "tmpdir". */
+static std::string
+Create()
+{
+	std::string dir;
+
+	{
+		std::lock_guard<std::mutex> guard(pool_lock);
+		dir = std::string(utils::tmpdir) + "/" + std::to_string(created++);
+	}
+	boost::filesystem::create_directories(dir);
+
+	return dir;
+}
+
+/*
+ * Removes the contents of "dir". Returns false if something could not be
+ * removed, e.g. a directory created without write permission.
+ */
+static bool
+Clean(std::string dir)
+{
+	std::vector<std::string> entries;
+	boost::system::error_code ec;
+	struct dirent *entry;
+	DIR *dirp;
+
+	if ((dirp = opendir(dir.c_str())) == NULL)
+		return false;
+	while ((entry = readdir(dirp)) != NULL) {
+		if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+			entries.push_back(dir + "/" + entry->d_name);
+	}
+	closedir(dirp);
+
+	/* Most of the commands leave the directory untouched. */
+	for (const auto &path : entries) {
+		boost::filesystem::remove_all(path, ec);
+		if (ec)
+			return false;
+	}
+
+	return true;
+}
+
+/* Creates "count" directories in advance, e.g. one per concurrent command. */
+void
+sandbox::Init(int count)
+{
+	std::vector<std::string> dirs;
+
+	for (int i = 0; i < count; i++)
+		dirs.push_back(Create());
+
+	std::lock_guard<std::mutex> guard(pool_lock);
+	pool.insert(pool.end(), dirs.begin(), dirs.end());
+}
+
+/* Returns an empty directory for executing a command. */
+std::string
+sandbox::Acquire()
+{
+	std::string dir;
+
+	{
+		std::lock_guard<std::mutex> guard(pool_lock);
+		if (!pool.empty()) {
+			dir = pool.back();
+			pool.pop_back();
+			return dir;
+		}
+	}
+
+	return Create();
+}
+
+/*
+ * Returns "dir" to the pool once the command executed inside it exits. A
+ * directory which cannot be emptied is abandoned (it is removed along with
+ * "tmpdir").
+ */
+void
+sandbox::Release(std::string dir)
+{
+	if (!Clean(dir)) {
+		std::cerr << "Unable to clean " << dir << ", not reusing it\n";
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(pool_lock);
+	pool.push_back(dir);
+}
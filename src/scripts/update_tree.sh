@@ -12,17 +12,34 @@ cd "$(dirname $0)/.."
 
 rsync -avzHP \
 	annotations \
+	bench \
 	README \
 	Makefile \
 	add_testcase.cpp add_testcase.h \
+	executor.cpp executor.h \
+	explore.cpp explore.h \
 	fetch_groff.cpp fetch_groff.h \
+	generate_annotations.cpp generate_annotations.h \
 	generate_license.cpp generate_license.h \
 	generate_test.cpp generate_test.h \
 	logging.cpp logging.h \
+	mdoc.cpp mdoc.h \
+	normalize.cpp normalize.h \
+	option_catalog.h \
+	option_index.cpp option_index.h \
+	output_store.cpp output_store.h \
+	probe_cache.cpp probe_cache.h \
+	probe_plan.cpp probe_plan.h \
 	read_annotations.cpp read_annotations.h \
+	run_tests.cpp run_tests.h \
+	sandbox.cpp sandbox.h \
+	shard.cpp shard.h \
+	thread_pool.cpp thread_pool.h \
+	trace.cpp trace.h \
 	utils.cpp utils.h \
+	watch.cpp watch.h \
 	$src
 
 rsync -avzHP \
-	scripts/README scripts/fetch_utils.sh scripts/generate_annot.sh \
+	scripts/README scripts/generate_annot.sh \
 	$src/scripts
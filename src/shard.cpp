@@ -0,0 +1,180 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "fetch_groff.h"
+#include "shard.h"
+#include "utils.h"
+
+int shard::index = 0;
+int shard::count = 0;
+
+/* Parses a shard specification "i/N". */
+bool
+shard::Parse(const char *spec)
+{
+	char trailing;
+
+	if (sscanf(spec, "%d/%d%c", &index, &count, &trailing) != 2 ||
+	    count < 1 || index < 0 || index >= count)
+		return false;
+	return true;
+}
+
+/*
+ * Checks whether "utility" belongs to this shard. Utilities are partitioned
+ * by a hash of their name, which is independent of the host and of the order
+ * in which the src tree is traversed.
+ */
+bool
+shard::Selected(std::string utility)
+{
+	if (count == 0)
+		return true;
+	return utils::Hash64(utility.c_str(), utility.size()) % count
+		== (uint64_t)index;
+}
+
+/* Writes the statistics of the utilities in "stats" to "path". */
+bool
+shard::WriteStats(std::string path, std::vector<Stat> stats)
+{
+	std::ostringstream data;
+
+	std::sort(stats.begin(), stats.end(),
+		  [](const Stat& a, const Stat& b) { return a.utility < b.utility; });
+	if (count > 0)
+		data << "# shard " << index << "/" << count << "\n";
+	for (const auto &it : stats)
+		data << it.utility << " " << it.section << " " << it.testcases << "\n";
+
+	return utils::WriteFileIfChanged(path, data.str());
+}
+
+/* Copies the file "from" to "to", creating the parent directories of the latter. */
+static bool
+CopyFile(boost::filesystem::path from, boost::filesystem::path to)
+{
+	std::ifstream file(from.string());
+	std::ostringstream data;
+
+	data << file.rdbuf();
+	if (!file) {
+		std::cerr << "Unable to read: " << from.string() << "\n";
+		return false;
+	}
+	boost::filesystem::create_directories(to.parent_path());
+	return utils::WriteFileIfChanged(to.string(), data.str());
+}
+
+/* Copies the regular files under "from" to the same location under "to". */
+static bool
+CopyTree(boost::filesystem::path from, boost::filesystem::path to)
+{
+	boost::filesystem::recursive_directory_iterator it(from), end;
+	std::string prefix = from.string();
+
+	for (; it != end; ++it) {
+		if (!boost::filesystem::is_regular_file(it->status()))
+			continue;
+		if (!CopyFile(it->path(), to / it->path().string().substr
+			      (prefix.size())))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Combines the outputs of the shards in "dirs": the generated tests are placed
+ * under "testsdir", the tests for the src tree (generated in batch mode) at
+ * their location in the src tree, and the statistics in "stats".
+ */
+int
+shard::Merge(const std::vector<std::string>& dirs, std::string testsdir)
+{
+	std::vector<bool> seen;
+	std::vector<Stat> stats;
+	std::string line;
+	Stat stat;
+	int shard_index;
+	int shard_count = 0;
+
+	/* Check that the outputs of all the shards are present. */
+	for (const auto &dir : dirs) {
+		std::ifstream file(dir + "/stats");
+
+		if (!std::getline(file, line) ||
+		    sscanf(line.c_str(), "# shard %d/%d", &shard_index,
+			   &shard_count) != 2 ||
+		    shard_index < 0 || shard_index >= shard_count) {
+			std::cerr << "Not a shard: " << dir << "\n";
+			return EXIT_FAILURE;
+		}
+		if (seen.empty())
+			seen.resize(shard_count, false);
+		if ((size_t)shard_count != seen.size() || seen[shard_index]) {
+			std::cerr << "Mismatched or duplicate shard: " << dir << "\n";
+			return EXIT_FAILURE;
+		}
+		seen[shard_index] = true;
+		while (file >> stat.utility >> stat.section >> stat.testcases)
+			stats.push_back(stat);
+	}
+	if (std::find(seen.begin(), seen.end(), false) != seen.end()) {
+		std::cerr << "Missing shards, expected " << seen.size() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	try {
+		boost::filesystem::create_directories(testsdir);
+		for (const auto &dir : dirs) {
+			if (!CopyTree(dir + "/generated_tests", testsdir))
+				return EXIT_FAILURE;
+			if (boost::filesystem::is_directory(dir + "/src") &&
+			    !CopyTree(dir + "/src", groff::srcdir))
+				return EXIT_FAILURE;
+		}
+	} catch (const boost::filesystem::filesystem_error& e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	count = 0;  /* The merged statistics are not of a shard. */
+	if (!WriteStats("stats", stats))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <string>
+#include <vector>
+
+/*
+ * Generation of the tests can be split across multiple processes (or hosts)
+ * via "--shard i/N", each of which writes its results under its own output
+ * directory:
+ *
+ * 	<outdir>/generated_tests/      Generated test scripts.
+ * 	<outdir>/src/<dir>/tests/      [Batch mode] Tests placed in src.
+ * 	<outdir>/stats                 Per-utility statistics.
+ *
+ * The outputs of all the N shards are combined via "--merge", producing the
+ * same result as a single run.
+ */
+namespace shard {
+	/* Statistics of the tests generated for a utility. */
+	struct Stat {
+		std::string utility;
+		char section;
+		int testcases;
+	};
+
+	extern int index;  /* Index of this shard, 0 <= index < count. */
+	extern int count;  /* Number of shards, 0 if not sharded. */
+
+	bool Parse(const char*);
+	bool Selected(std::string);
+	bool WriteStats(std::string, std::vector<Stat>);
+	int Merge(const std::vector<std::string>&, std::string);
+}
+
+#endif  /* _SHARD_H_ */
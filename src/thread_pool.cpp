@@ -0,0 +1,153 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include "thread_pool.h"
+
+/*
+ * Index of the worker (in the pool it belongs to) running on the current
+ * thread, used for placing tasks submitted by a worker on its own queue.
+ */
+static thread_local threadpool::ThreadPool *current_pool = NULL;
+static thread_local int current_worker = -1;
+
+threadpool::ThreadPool::ThreadPool(int size)
+	: queued(0), pending(0), next_queue(0), shutdown(false)
+{
+	if (size < 1)
+		size = 1;
+	for (int i = 0; i < size; i++)
+		queues.emplace_back(new WorkQueue);
+	for (int i = 0; i < size; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+threadpool::ThreadPool::~ThreadPool()
+{
+	Wait();
+	{
+		std::lock_guard<std::mutex> guard(state_lock);
+		shutdown = true;
+	}
+	work_cv.notify_all();
+	for (auto &worker : workers)
+		worker.join();
+}
+
+/* Schedules "task" for execution on one of the workers. */
+void
+threadpool::ThreadPool::Submit(Task task)
+{
+	int index;
+
+	if (current_pool == this) {
+		index = current_worker;
+	} else {
+		std::lock_guard<std::mutex> guard(state_lock);
+		index = next_queue++ % queues.size();
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> guard(state_lock);
+		queued++;
+		pending++;
+	}
+	work_cv.notify_one();
+}
+
+/* Blocks until every submitted task (including nested ones) has finished. */
+void
+threadpool::ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> guard(state_lock);
+	done_cv.wait(guard, [this] { return pending == 0; });
+}
+
+/*
+ * Takes a task from the back of the queue owned by worker "index", or steals
+ * one from the front of another worker's queue.
+ */
+bool
+threadpool::ThreadPool::PopTask(int index, Task& task)
+{
+	for (size_t i = 0; i < queues.size(); i++) {
+		WorkQueue *queue = queues[(index + i) % queues.size()].get();
+		std::lock_guard<std::mutex> guard(queue->lock);
+
+		if (queue->tasks.empty())
+			continue;
+		if (i == 0) {
+			task = std::move(queue->tasks.back());
+			queue->tasks.pop_back();
+		} else {
+			task = std::move(queue->tasks.front());
+			queue->tasks.pop_front();
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void
+threadpool::ThreadPool::WorkerLoop(int index)
+{
+	Task task;
+
+	current_pool = this;
+	current_worker = index;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(state_lock);
+			work_cv.wait(guard, [this] { return queued > 0 || shutdown; });
+			if (queued == 0)
+				return;
+			/*
+			 * Claim one of the queued tasks. Since a task is pushed
+			 * on a queue before "queued" is incremented, the claimed
+			 * task is guaranteed to be found by PopTask().
+			 */
+			queued--;
+		}
+
+		while (!PopTask(index, task))
+			std::this_thread::yield();
+		task();
+		task = nullptr;
+
+		{
+			std::lock_guard<std::mutex> guard(state_lock);
+			if (--pending == 0)
+				done_cv.notify_all();
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threadpool {
+	typedef std::function<void()> Task;
+
+	/*
+	 * A pool of worker threads, each of which owns a double-ended queue of
+	 * tasks. A worker pops tasks from the back of its own queue and when
+	 * it runs dry, steals from the front of the queues of other workers.
+	 * Tasks are allowed to submit further tasks, which are then placed on
+	 * the queue of the submitting worker.
+	 */
+	class ThreadPool {
+	public:
+		ThreadPool(int);
+		~ThreadPool();
+
+		void Submit(Task);
+		void Wait();
+		int Size() { return workers.size(); }
+
+	private:
+		struct WorkQueue {
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex state_lock;             /* Protects the counters below. */
+		std::condition_variable work_cv;   /* Signalled when a task is queued. */
+		std::condition_variable done_cv;   /* Signalled when all tasks finish. */
+		size_t queued;                     /* Tasks waiting in the queues. */
+		size_t pending;                    /* Tasks submitted but not finished. */
+		size_t next_queue;                 /* Round-robin index for Submit(). */
+		bool shutdown;
+
+		void WorkerLoop(int);
+		bool PopTask(int, Task&);
+	};
+}
+
+#endif  /* _THREAD_POOL_H_ */
@@ -0,0 +1,170 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+#include "trace.h"
+#include "utils.h"
+
+std::string trace::tracefile;
+
+/* Events recorded so far, as comma-separated JSON objects. */
+static std::mutex trace_lock;
+static std::string events;
+static const trace::Clock::time_point epoch = trace::Clock::now();
+static std::atomic<int> next_tid(1);
+static std::atomic<long> next_id(1);
+
+/* Small, stable identifier of the calling thread. */
+static int
+ThreadId()
+{
+	static thread_local int tid = next_tid++;
+	return tid;
+}
+
+/* Microseconds elapsed between the start of the run and "time". */
+static long
+Timestamp(trace::Clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>
+		(time - epoch).count();
+}
+
+/* Returns "str" as a JSON string. */
+std::string
+trace::Quote(std::string str)
+{
+	std::string quoted = "\"";
+	char escape[8];
+
+	for (const auto &c : str) {
+		if (c == '"' || c == '\\') {
+			quoted.push_back('\\');
+			quoted.push_back(c);
+		} else if ((unsigned char)c < 0x20) {
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			quoted.append(escape);
+		} else {
+			quoted.push_back(c);
+		}
+	}
+	quoted.push_back('"');
+
+	return quoted;
+}
+
+/* Appends an event, the "fields" of which follow its name and category. */
+static void
+Record(std::string name, std::string category, std::string fields,
+       const trace::Args& args)
+{
+	std::string event = "{\"name\":" + trace::Quote(name)
+			  + ",\"cat\":" + trace::Quote(category)
+			  + ",\"pid\":" + std::to_string(getpid())
+			  + ",\"tid\":" + std::to_string(ThreadId())
+			  + fields;
+
+	if (!args.empty()) {
+		event += ",\"args\":{";
+		for (size_t i = 0; i < args.size(); i++) {
+			if (i > 0)
+				event += ",";
+			event += trace::Quote(args[i].first) + ":" + args[i].second;
+		}
+		event += "}";
+	}
+	event += "}";
+
+	std::lock_guard<std::mutex> guard(trace_lock);
+	if (!events.empty())
+		events += ",\n";
+	events += event;
+}
+
+/* Records a span of the calling thread. */
+void
+trace::Complete(std::string name, std::string category, Clock::time_point start,
+		Clock::time_point end, const Args& args)
+{
+	if (tracefile.empty())
+		return;
+	Record(name, category, ",\"ph\":\"X\",\"ts\":"
+	       + std::to_string(Timestamp(start)) + ",\"dur\":"
+	       + std::to_string(Timestamp(end) - Timestamp(start)), args);
+}
+
+/*
+ * Records a span which may overlap with the other spans of the calling
+ * thread, e.g. a command executed concurrently with others.
+ */
+void
+trace::Async(std::string name, std::string category, Clock::time_point start,
+	     Clock::time_point end, const Args& args)
+{
+	std::string id;
+
+	if (tracefile.empty())
+		return;
+	id = std::to_string(next_id++);
+	Record(name, category, ",\"ph\":\"b\",\"id\":" + id + ",\"ts\":"
+	       + std::to_string(Timestamp(start)), args);
+	Record(name, category, ",\"ph\":\"e\",\"id\":" + id + ",\"ts\":"
+	       + std::to_string(Timestamp(end)), Args());
+}
+
+/* Writes the recorded events to "tracefile". */
+void
+trace::Write()
+{
+	if (tracefile.empty())
+		return;
+
+	std::lock_guard<std::mutex> guard(trace_lock);
+	if (!utils::WriteFileAtomic(tracefile, "{\"traceEvents\":[\n" + events
+				    + "\n],\"displayTimeUnit\":\"ms\"}\n"))
+		std::cerr << "Unable to write trace: " << tracefile << "\n";
+}
+
+trace::Span::Span(std::string name, std::string category)
+	: name(name), category(category)
+{
+	if (!tracefile.empty())
+		start = Clock::now();
+}
+
+trace::Span::~Span()
+{
+	if (!tracefile.empty())
+		Complete(name, category, start, Clock::now(), args);
+}
@@ -0,0 +1,72 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Opt-in tracing of the stages of test generation, written out in the Chrome
+ * trace event format (loadable in chrome://tracing or Perfetto).
+ */
+namespace trace {
+	typedef std::chrono::steady_clock Clock;
+	/* Arguments of an event, as (name, JSON value) pairs. */
+	typedef std::vector<std::pair<std::string, std::string>> Args;
+
+	extern std::string tracefile;  /* Empty if tracing is disabled. */
+
+	std::string Quote(std::string);
+	void Complete(std::string, std::string, Clock::time_point,
+		      Clock::time_point, const Args& = Args());
+	void Async(std::string, std::string, Clock::time_point,
+		   Clock::time_point, const Args& = Args());
+	void Write();
+
+	/* Records the lifetime of the object as a span of the calling thread. */
+	class Span {
+	public:
+		Span(std::string, std::string);
+		~Span();
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+		Args args;
+
+	private:
+		std::string name;
+		std::string category;
+		Clock::time_point start;
+	};
+}
+
+#endif  /* _TRACE_H_ */
@@ -27,128 +27,333 @@
  */
 
 #include <fcntl.h>
+#include <paths.h>
 #include <signal.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __FreeBSD__
+#include <sys/event.h>
+#include <sys/proc.h>
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
 
 #include "utils.h"
+#include "executor.h"
 #include "fetch_groff.h"
 #include "logging.h"
+#include "option_index.h"
 
 #define READ 0   /* Pipe descriptor: read end. */
 #define WRITE 1	 /* Pipe descriptor: write end. */
+
+const char *utils::tmpdir = "tmpdir";
+char *const utils::probe_environ[] = { NULL };
+bool utils::split_output = false;
+int utils::repeat = 1;
+rlim_t utils::probe_limits[utils::LIMITS] = {
+	60,          /* LIMIT_CPU */
+	1UL << 30,   /* LIMIT_AS */
+	64UL << 20,  /* LIMIT_FSIZE */
+	0,           /* LIMIT_CORE */
+};
+
+/* Resource, name (see ParseLimit()) and unit of each of "probe_limits". */
+static const struct {
+	decltype(RLIMIT_CPU) resource;  /* An enum with glibc. */
+	const char *name;
+	rlim_t unit;
+} limit_resources[utils::LIMITS] = {
+	{ RLIMIT_CPU,   "cpu",   1 },
+	{ RLIMIT_AS,    "as",    1UL << 20 },
+	{ RLIMIT_FSIZE, "fsize", 1UL << 20 },
+	{ RLIMIT_CORE,  "core",  1UL << 20 },
+};
+
+/* Memoized results of ResolveUtility() and HashFile(). */
+static std::mutex resolve_lock;
+static std::unordered_map<std::string, std::string> resolved_utils;
+/* The hash of a file is recomputed only once the file is changed. */
+struct FileHash {
+	ino_t ino;
+	int64_t mtime;  /* Nanoseconds. */
+	off_t size;
+	uint64_t hash;
+};
+static std::unordered_map<std::string, FileHash> file_hashes;
+
 /*
- * Buffer size (used for buffering output generated
- * after executing the utility-specific command).
+ * 64-bit FNV-1a hash of "len" bytes starting at "data". Data can be hashed
+ * incrementally by passing the hash of the preceding bytes as "hash".
  */
-#define BUFSIZE 128
-#define TIMEOUT 1  /* Threshold (seconds) for a function call to return. */
+uint64_t
+utils::Hash64(const char *data, size_t len, uint64_t hash)
+{
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3ULL;
+	}
 
-const char *utils::tmpdir = "tmpdir";
+	return hash;
+}
 
 /*
- * Inserts a list of user-defined option definitions into a hashmap. These
- * specific option definitions are the ones which can be easily tested.
+ * Returns a hash of the contents of the file at "path", or 0 if the file
+ * cannot be read. The hash is computed again only if the file was modified
+ * (or replaced) since the last call, which matters for "--watch".
  */
-void
-utils::OptDefinition::InsertOpts()
+uint64_t
+utils::HashFile(std::string path)
 {
-	/* Option definitions. */
-	OptRelation h_def;  /* '-h' */
-	h_def.type    = 's';
-	h_def.value   = "h";
-	h_def.keyword = "help";
-
-	OptRelation v_def;  /* '-v' */
-	v_def.type    = 's';
-	v_def.value   = "v";
-	v_def.keyword = "version";
-
-	/* "opt_map" contains all the options which can be easily tested. */
-	opt_map.insert(std::make_pair<std::string, OptRelation>
-		      ("h", (OptRelation)h_def));
-	opt_map.insert(std::make_pair<std::string, OptRelation>
-		      ("v", (OptRelation)v_def));
-};
+	std::array<char, 65536> buffer;
+	uint64_t hash = utils::Hash64(NULL, 0);
+	struct stat sb;
+	int64_t mtime;
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(path.c_str(), O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	if (fstat(fd, &sb) < 0) {
+		close(fd);
+		return 0;
+	}
+	mtime = (int64_t)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+
+	{
+		std::lock_guard<std::mutex> guard(resolve_lock);
+		auto it = file_hashes.find(path);
+		if (it != file_hashes.end() && it->second.ino == sb.st_ino &&
+		    it->second.mtime == mtime && it->second.size == sb.st_size) {
+			close(fd);
+			return it->second.hash;
+		}
+	}
+
+	while ((len = read(fd, buffer.data(), buffer.size())) > 0)
+		hash = utils::Hash64(buffer.data(), len, hash);
+	close(fd);
+	if (len < 0)
+		return 0;
+
+	std::lock_guard<std::mutex> guard(resolve_lock);
+	file_hashes[path] = { sb.st_ino, mtime, sb.st_size, hash };
+	return hash;
+}
+
+/*
+ * Returns the path of the executable which the shell would run for
+ * "utility". Since commands are executed with an empty environment, the
+ * shell searches the default path. An empty string is returned if the
+ * utility is not found.
+ */
+std::string
+utils::ResolveUtility(std::string utility)
+{
+	std::string path;
+	std::string dir;
+	std::istringstream search_path(_PATH_DEFPATH);
+
+	{
+		std::lock_guard<std::mutex> guard(resolve_lock);
+		auto it = resolved_utils.find(utility);
+		if (it != resolved_utils.end())
+			return it->second;
+	}
+
+	if (utility.find('/') != std::string::npos) {
+		if (access(utility.c_str(), X_OK) == 0)
+			path = utility;
+	} else {
+		while (std::getline(search_path, dir, ':')) {
+			std::string candidate = dir + "/" + utility;
+			if (access(candidate.c_str(), X_OK) == 0) {
+				path = candidate;
+				break;
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(resolve_lock);
+	resolved_utils[utility] = path;
+	return path;
+}
+
+/*
+ * Replaces the file at "path" with "data". The data is written to a
+ * temporary file in the same directory which is then renamed, so that
+ * readers (possibly on other hosts sharing the directory) never observe a
+ * partially written file.
+ */
+bool
+utils::WriteFileAtomic(std::string path, const std::string& data)
+{
+	std::string temp = path + ".XXXXXX";
+	const char *ptr = data.data();
+	size_t remaining = data.size();
+	ssize_t len;
+	int fd;
+
+	if ((fd = mkstemp(&temp[0])) < 0) {
+		logging::LogPerror("mkstemp()");
+		return false;
+	}
+	while (remaining > 0) {
+		if ((len = write(fd, ptr, remaining)) < 0) {
+			if (errno == EINTR)
+				continue;
+			logging::LogPerror("write()");
+			close(fd);
+			unlink(temp.c_str());
+			return false;
+		}
+		ptr += len;
+		remaining -= len;
+	}
+	/* mkstemp() creates the file with mode 0600. */
+	fchmod(fd, 0644);
+	close(fd);
+
+	if (rename(temp.c_str(), path.c_str()) < 0) {
+		logging::LogPerror("rename()");
+		unlink(temp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+/* Returns true if the file at "path" holds exactly "data". */
+static bool
+SameContents(std::string path, const std::string& data)
+{
+	struct stat sb;
+	char buf[65536];
+	size_t offset = 0;
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+		return false;
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size != data.size()) {
+		close(fd);
+		return false;
+	}
+	while (offset < data.size()) {
+		if ((len = read(fd, buf, sizeof(buf))) < 0 && errno == EINTR)
+			continue;
+		if (len <= 0 || offset + len > data.size() ||
+		    memcmp(buf, data.data() + offset, len) != 0) {
+			close(fd);
+			return false;
+		}
+		offset += len;
+	}
+	close(fd);
+
+	return true;
+}
+
+/*
+ * Same as WriteFileAtomic(), except that the file is left untouched (keeping
+ * its modification time) if it already holds "data".
+ */
+bool
+utils::WriteFileIfChanged(std::string path, const std::string& data)
+{
+	if (SameContents(path, data))
+		return true;
+	return WriteFileAtomic(path, data);
+}
+
+/*
+ * Collects the options accepted by "utility" from its man page "manpage",
+ * recording which of the keywords of the option catalog appear in the
+ * description of each.
+ */
+static bool
+ParseManpage(std::string manpage, std::vector<optionindex::Option>& options)
+{
+	std::unordered_set<std::string> seen;  /* Options already collected. */
+	mdoc::Page page;
+	uint32_t mask;
+
+	if (!page.Open(manpage))
+		return false;
+
+	for (const auto &opt : page.options) {
+		if (!seen.insert(opt.name).second)
+			continue;
+		mask = 0;
+		for (size_t i = 0; i < std::size(optcatalog::keywords); i++) {
+			if (opt.description.find(optcatalog::keywords[i]) !=
+			    std::string_view::npos)
+				mask |= 1U << i;
+		}
+		options.push_back({opt.name, opt.arg, mask,
+				   (uint16_t)opt.group, (uint16_t)opt.forms});
+	}
+	/* Options mentioned only in the synopsis have an unknown usage. */
+	for (const auto &opt : page.synopsis_options) {
+		if (seen.insert(opt.name).second)
+			options.push_back({opt.name, opt.arg, 0,
+					   (uint16_t)opt.group,
+					   (uint16_t)opt.forms});
+	}
+
+	return true;
+}
 
 /*
- * Finds the supported options present in the hashmap generated by InsertOpts()
- * for the utility under test, and returns them in a form of list of option
- * relations.
+ * Finds the supported options present in the option catalog for the utility
+ * under test, and returns the indices of their relations in the catalog.
+ * The options are looked up in the option index, and the man page is parsed
+ * only if it changed since the index was built.
  */
-std::vector<utils::OptRelation *>
+std::vector<optcatalog::Index>
 utils::OptDefinition::CheckOpts(std::string utility)
 {
-	std::string opt_id = ".It Fl";  /* Option identifier in man page. */
-	std::string line;               /* An individual line in a man-page. */
-	std::string opt_name;           /* Name of the option. */
-	std::string opt_desc;           /* Option description extracted from man-page. */
-	std::string opt_string;         /* Identified option names. */
-	int opt_pos;                    /* Starting index of the (identified) option. */
-	int space_index;                /* First occurrence of space in option definition. */
-	std::vector<OptRelation *> identified_opts;
-	std::vector<std::string> supported_sections = { "1", "8" };
-
-	InsertOpts();  /* Generate the hashmap "opt_map". */
-	std::ifstream infile(groff::groff_map[utility]);
+	std::vector<optcatalog::Index> identified_opts;
+	std::vector<optionindex::Option> options;
+	std::string manpage = groff::groff_map.at(utility);
+	size_t i;
+
+	if (!optionindex::Lookup(utility, manpage, options)) {
+		if (!ParseManpage(manpage, options))
+			return identified_opts;
+		optionindex::Update(utility, manpage, options);
+	}
 
 	/*
-	 * Search for all the options accepted by the utility and collect those
-	 * present in "opt_map".
+	 * Collect the options present in the catalog whose description
+	 * matches the keyword of (any of) their relations.
 	 */
-	while (std::getline(infile, line)) {
-		if ((opt_pos = line.find(opt_id)) != std::string::npos) {
-			/* Locate the position of option name. */
-			opt_pos += opt_id.size() + 1;
-			if (opt_pos > line.size()) {
-				/*
-				 * This condition will trigger when a utility
-				 * supports an empty argument, e.g. tset(issue #9)
-				 */
-				continue;
-			}
-
-			/*
-			 * Check for long options ; While here, also sanitize
-			 * multi-word option definitions in a man page to properly
-			 * extract short options from option definitions such as:
-			 * 	.It Fl r Ar seconds (taken from date(1)).
-			 */
-			if ((space_index = line.find(" ", opt_pos + 1, 1))
-					!= std::string::npos)
-				opt_name = line.substr(opt_pos, space_index - opt_pos);
-			else
-				opt_name = line.substr(opt_pos);
-
-			/*
-			 * Check if the identified option matches the identifier.
-			 * "opt_list.back()" is the previously checked option, the
-			 * description of which is now stored in "opt_desc".
-			 */
-			if (!opt_list.empty() &&
-			   (opt_map_iter = opt_map.find(opt_list.back()))
-					!= opt_map.end() &&
-			    opt_desc.find((opt_map_iter->second).keyword) != std::string::npos) {
-				identified_opts.push_back(&(opt_map_iter->second));
-				/* Remove options with a known usage. */
-				opt_list.pop_back();
-			}
-			opt_list.push_back(opt_name);
-			opt_desc.clear();
-		} else {
-			/*
-			 * Collect the option description until next valid
-			 * option definition is encountered.
-			 */
-			opt_desc.append(line);
+	for (const auto &opt : options) {
+		opt_args[opt.name] = opt.arg;
+		opt_synopsis[opt.name] = { opt.group, opt.forms };
+		i = optcatalog::Classify(opt.name, opt.keywords);
+		if (i < optcatalog::CATALOG_SIZE) {
+			identified_opts.push_back(i);
+			/* Options with a known usage are not listed. */
+			continue;
 		}
+		opt_list.push_back(opt.name);
 	}
 
 	return identified_opts;
@@ -162,54 +367,123 @@ utils::GenerateCommand(std::string utility, std::string opt)
 
 	if (!opt.empty())
 		command += " -" + opt;
-	command += " 2>&1 </dev/null";
+	if (!split_output)
+		command += " 2>&1";
+	command += " </dev/null";
 
 	return command;
 }
 
+/*
+ * Splits "command" into arguments and redirections if it can be executed
+ * without a shell, i.e. it is a single simple command whose only
+ * redirections are the ones added by GenerateCommand(). Returns false if the
+ * command makes use of any other shell syntax.
+ */
+bool
+utils::ParseCommand(std::string command, SimpleCommand& simple_command)
+{
+	std::istringstream words(command);
+	std::string word;
+
+	simple_command.argv.clear();
+	simple_command.stderr_to_stdout = false;
+	simple_command.stdin_null = false;
+
+	while (words >> word) {
+		if (word == "2>&1") {
+			simple_command.stderr_to_stdout = true;
+		} else if (word == "</dev/null") {
+			simple_command.stdin_null = true;
+		} else if (word.find_first_of("|&;<>()$`\\\"'*?[]{}~#!") !=
+			   std::string::npos) {
+			return false;
+		} else {
+			simple_command.argv.push_back(word);
+		}
+	}
+
+	/* Variable assignments are handled by the shell as well. */
+	return !simple_command.argv.empty() &&
+	       simple_command.argv.front().find('=') == std::string::npos;
+}
+
+/*
+ * Computes the resource limits of a command, i.e. "probe_limits" capped by
+ * the hard limits of the generator (which cannot be raised). Both the soft
+ * and the hard limits are set, so that the utility cannot raise them either.
+ */
+static void
+ProbeLimits(struct rlimit limits[utils::LIMITS])
+{
+	for (int i = 0; i < utils::LIMITS; i++) {
+		if (getrlimit(limit_resources[i].resource, &limits[i]) < 0)
+			limits[i].rlim_max = RLIM_INFINITY;
+		limits[i].rlim_cur = std::min(utils::probe_limits[i],
+					      limits[i].rlim_max);
+		limits[i].rlim_max = limits[i].rlim_cur;
+	}
+}
+
 /*
  * When pclose() is called on the stream returned by popen(), it waits
  * indefinitely for the created shell process to terminate in cases where the
  * shell command waits for the user input via a blocking read (e.g. passwd(1)).
  * Hence, we define a custom function which alongside returning the read-write
  * file descriptors, also returns the pid of the newly created (child) shell
- * process. This pid can be later used for signalling the child.
+ * process. This pid can be later used for signalling the child. The command
+ * is executed inside the directory "dir".
  */
 utils::PipeDescriptor*
-utils::POpen(const char *command)
+utils::POpen(const char *command, const char *dir)
 {
 	int pdes[2];
+	int errdes[2];
 	char *argv[4];
 	pid_t child_pid;
-	PipeDescriptor *pipe_descr = (PipeDescriptor *)malloc(sizeof(PipeDescriptor));
+	PipeDescriptor *pipe_descr;
+	struct rlimit limits[LIMITS];
 
 	/*
-	 * Create a pipe with ~
+	 * Create pipes with ~
 	 *   - pdes[READ]: read end
 	 *   - pdes[WRITE]: write end
+	 * and similarly "errdes" for stderr.
 	 */
 	if (pipe2(pdes, O_CLOEXEC) < 0)
 		return NULL;
+	if (pipe2(errdes, O_CLOEXEC) < 0) {
+		close(pdes[READ]);
+		close(pdes[WRITE]);
+		return NULL;
+	}
+	pipe_descr = (PipeDescriptor *)malloc(sizeof(PipeDescriptor));
 	pipe_descr->readfd = pdes[READ];
 	pipe_descr->writefd = pdes[WRITE];
+	pipe_descr->errfd = errdes[READ];
 
 	/* Type-cast to avoid compiler warnings [-Wwrite-strings]. */
 	argv[0] = (char *)"sh";
 	argv[1] = (char *)"-c";
 	argv[2] = (char *)command;
 	argv[3] = NULL;
+	/* Computed beforehand, as the child shares the parent's memory. */
+	ProbeLimits(limits);
 
 	switch (child_pid = vfork()) {
 	case -1: 		/* Error. */
 		free(pipe_descr);
 		close(pdes[READ]);
 		close(pdes[WRITE]);
+		close(errdes[READ]);
+		close(errdes[WRITE]);
 		return NULL;
 	case 0: 		/* Child. */
 		if (pdes[WRITE] != STDOUT_FILENO)
 			dup2(pdes[WRITE], STDOUT_FILENO);
 		else
 			fcntl(pdes[WRITE], F_SETFD, 0);
+		dup2(errdes[WRITE], STDERR_FILENO);
 		if (pdes[READ] != STDIN_FILENO)
 			dup2(pdes[READ], STDIN_FILENO);
 		else
@@ -217,95 +491,277 @@ utils::POpen(const char *command)
 		/*
 		 * For current usecase, it might so happen that the child gets
 		 * stuck on a blocking read (e.g. passwd(1)) waiting for user
-		 * input. In that case the child will be killed via a signal.
-		 * To avoid any effect on the parent's execution, we place the
-		 * child in a separate process group with pgid set as
-		 * "child_pid".
+		 * input. To avoid any effect on the parent's execution, we
+		 * place the child in a new session (and hence a separate
+		 * process group). The new session has no controlling terminal,
+		 * hence utilities trying to open /dev/tty fail immediately
+		 * instead of blocking until they are killed.
+		 */
+		setsid();
+		for (int i = 0; i < LIMITS; i++)
+			setrlimit(limit_resources[i].resource, &limits[i]);
+		/*
+		 * Execute "command" inside "dir". Changing the directory in
+		 * the child leaves the working directory of the (possibly
+		 * multi-threaded) parent untouched.
 		 */
-		setpgid(child_pid, child_pid);
-		execve("/bin/sh", argv, NULL);
-		exit(127);
+		if (chdir(dir) < 0)
+			_exit(127);
+		execve("/bin/sh", argv, probe_environ);
+		_exit(127);
 	}
 
+	close(errdes[WRITE]);
 	pipe_descr->pid = child_pid;
 	return pipe_descr;
 }
 
 /*
- * Executes the command passed as argument in a shell and returns its output
- * and exit status.
+ * Executes "path" (as "argv") with the redirections of "simple_command" via
+ * vfork(2), setting the resource "limits" before the utility is executed.
+ * Returns the pid of the child, or -1 with "errno" set if the utility cannot
+ * be executed.
  */
-std::pair<std::string, int>
-utils::Execute(std::string command)
+static pid_t
+LimitedSpawn(const char *path, char *const argv[],
+	     const utils::SimpleCommand& simple_command,
+	     const char *dir, const int pdes[2], const int errdes[2],
+	     const struct rlimit limits[utils::LIMITS])
+{
+	volatile int exec_error = 0;  /* Shared with the vfork(2)ed child. */
+	pid_t child_pid;
+	int fd;
+
+	switch (child_pid = vfork()) {
+	case -1:		/* Error. */
+		return -1;
+	case 0:			/* Child. */
+		dup2(pdes[WRITE], STDOUT_FILENO);
+		dup2(simple_command.stderr_to_stdout ? pdes[WRITE]
+						     : errdes[WRITE],
+		     STDERR_FILENO);
+		if (!simple_command.stdin_null)
+			dup2(pdes[READ], STDIN_FILENO);
+		else if ((fd = open("/dev/null", O_RDONLY)) >= 0 &&
+			 fd != STDIN_FILENO) {
+			dup2(fd, STDIN_FILENO);
+			close(fd);
+		}
+		/* See POpen() for why the child is placed in a new session. */
+		setsid();
+		for (int i = 0; i < utils::LIMITS; i++)
+			setrlimit(limit_resources[i].resource, &limits[i]);
+		if (chdir(dir) == 0)
+			execve(path, argv, utils::probe_environ);
+		exec_error = errno;
+		_exit(127);
+	}
+
+	/* The child has either executed the utility or exited by now. */
+	if (exec_error != 0) {
+		waitpid(child_pid, NULL, 0);
+		errno = exec_error;
+		return -1;
+	}
+	return child_pid;
+}
+
+/*
+ * Executes "simple_command" directly via LimitedSpawn(), avoiding the startup
+ * cost of a shell. Returns NULL if the utility cannot be spawned this way, in
+ * which case the caller should fall back to POpen().
+ */
+utils::PipeDescriptor*
+utils::PSpawn(std::string path, const SimpleCommand& simple_command,
+	      const char *dir)
 {
-	int result;
-	int exitstatus;
-	std::array<char, BUFSIZE> buffer;
-	std::string usage_output;
-	struct timeval tv;
-	fd_set readfds;
-	FILE *pipe;
+	int pdes[2];
+	int errdes[2] = { -1, -1 };
+	pid_t child_pid;
+	std::vector<char *> argv;
 	PipeDescriptor *pipe_descr;
-	pid_t pid;
-	int pstat;
-
-	/* Execute "command" inside "tmpdir". */
-	chdir(tmpdir);
-	pipe_descr = utils::POpen(command.c_str());
-	chdir("..");
-	if (pipe_descr == NULL) {
-		logging::LogPerror("utils::POpen()");
-		exit(EXIT_FAILURE);
+	struct rlimit limits[LIMITS];
+
+	if (path.empty() || pipe2(pdes, O_CLOEXEC) < 0)
+		return NULL;
+	if (!simple_command.stderr_to_stdout && pipe2(errdes, O_CLOEXEC) < 0) {
+		close(pdes[READ]);
+		close(pdes[WRITE]);
+		return NULL;
 	}
 
-	/* Close the unrequired file-descriptor. */
-	close(pipe_descr->writefd);
-	pipe = fdopen(pipe_descr->readfd, "r");
-	free(pipe_descr);
-	if (pipe == NULL) {
-		close(pipe_descr->readfd);
-		logging::LogPerror("fdopen()");
-		exit(EXIT_FAILURE);
+	for (const auto &arg : simple_command.argv)
+		argv.push_back((char *)arg.c_str());
+	argv.push_back(NULL);
+
+	ProbeLimits(limits);
+	child_pid = LimitedSpawn(path.c_str(), argv.data(), simple_command,
+				 dir, pdes, errdes, limits);
+
+	if (errdes[WRITE] >= 0)
+		close(errdes[WRITE]);
+	if (child_pid < 0) {
+		close(pdes[READ]);
+		close(pdes[WRITE]);
+		if (errdes[READ] >= 0)
+			close(errdes[READ]);
+		return NULL;
 	}
 
-	/* Set a timeout for shell process to complete its execution. */
-	tv.tv_sec = TIMEOUT;
-	tv.tv_usec = 0;
-	FD_ZERO(&readfds);
-	FD_SET(fileno(pipe), &readfds);
-	result = select(fileno(pipe) + 1, &readfds, NULL, NULL, &tv);
-
-	if (result > 0) {
-		while (!feof(pipe) && !ferror(pipe)) {
-			if (fgets(buffer.data(), BUFSIZE, pipe) != NULL)
-				usage_output += buffer.data();
+	pipe_descr = (PipeDescriptor *)malloc(sizeof(PipeDescriptor));
+	pipe_descr->readfd = pdes[READ];
+	pipe_descr->writefd = pdes[WRITE];
+	pipe_descr->errfd = errdes[READ];
+	pipe_descr->pid = child_pid;
+	return pipe_descr;
+}
+
+/*
+ * Checks whether the process "pid" is sleeping in a read from a terminal, a
+ * pipe or a socket, i.e. it is waiting for input which is never going to
+ * arrive.
+ */
+bool
+utils::BlockedOnRead(pid_t pid)
+{
+#if defined(__FreeBSD__)
+	static const char *wmesgs[] = { "ttyin", "piperd", "sbwait", "fifoor" };
+	struct kinfo_proc kp;
+	size_t len = sizeof(kp);
+	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, pid };
+
+	if (sysctl(mib, 4, &kp, &len, NULL, 0) < 0 || len != sizeof(kp))
+		return false;
+	if (kp.ki_stat != SSLEEP)
+		return false;
+	for (const auto &wmesg : wmesgs) {
+		if (!strcmp(kp.ki_wmesg, wmesg))
+			return true;
+	}
+	return false;
+#elif defined(__linux__)
+	static const char *wchans[] = { "pipe_read", "pipe_wait", "n_tty_read",
+		"unix_stream_read_generic", "unix_stream_data_wait",
+		"sk_wait_data", "wait_for_partner" };
+	std::string procdir = "/proc/" + std::to_string(pid);
+	std::string stat;
+	std::string wchan;
+	size_t pos;
+
+	std::ifstream stat_file(procdir + "/stat");
+	std::getline(stat_file, stat);
+	/* The state follows the command name, which is in parentheses. */
+	if ((pos = stat.rfind(')')) == std::string::npos ||
+	    stat.compare(pos + 1, 3, " S ") != 0)
+		return false;
+
+	std::ifstream wchan_file(procdir + "/wchan");
+	std::getline(wchan_file, wchan);
+	for (const auto &name : wchans) {
+		if (wchan == name)
+			return true;
+	}
+	return false;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Returns a descriptor which becomes readable (see poll(2)) once the process
+ * "pid" exits, so that its exit is waited for along with its output. Returns
+ * -1 if this is not supported, or if the process is already gone.
+ */
+int
+utils::ExitDescriptor(pid_t pid)
+{
+#if defined(__FreeBSD__)
+	struct kevent kev;
+	int kq;
+
+	if ((kq = kqueue()) < 0)
+		return -1;
+	EV_SET(&kev, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+	if (kevent(kq, &kev, 1, NULL, 0, NULL) < 0) {
+		close(kq);
+		return -1;
+	}
+	return kq;
+#elif defined(__linux__) && defined(SYS_pidfd_open)
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Parses a resource limit of the executed commands (see "probe_limits") of the
+ * form "<resource>=<value>", where the resource is one of "cpu" (seconds),
+ * "as", "fsize" or "core" (MB), and the value may be "unlimited".
+ */
+bool
+utils::ParseLimit(const char *arg)
+{
+	const char *value = strchr(arg, '=');
+	char *end;
+	unsigned long limit;
+
+	if (value == NULL)
+		return false;
+	for (int i = 0; i < LIMITS; i++) {
+		if (std::string_view(arg, value - arg) != limit_resources[i].name)
+			continue;
+		if (!strcmp(++value, "unlimited")) {
+			probe_limits[i] = RLIM_INFINITY;
+			return true;
 		}
-	} else if (result == -1) {
-		logging::LogPerror("select()");
-		if (kill(pipe_descr->pid, SIGTERM) < 0)
-			logging::LogPerror("kill()");
-	} else if (result == 0) {
-		/*
-		 * We gave a relaxed value of TIMEOUT seconds for the shell
-		 * process to complete it's execution. If at this point it is
-		 * still alive, it (most probably) is stuck on a blocking read
-		 * waiting for the user input. Since a few of the utilities
-		 * performing such blocking reads don't respond to SIGINT (e.g.
-		 * pax(1)), we terminate the shell process via SIGTERM.
-		 */
-		if (kill(pipe_descr->pid, SIGTERM) < 0)
-			logging::LogPerror("kill()");
+		errno = 0;
+		limit = strtoul(value, &end, 10);
+		if (*value == '\0' || *end != '\0' || errno != 0 ||
+		    limit > (unsigned long)(RLIM_INFINITY / limit_resources[i].unit))
+			return false;
+		probe_limits[i] = limit * limit_resources[i].unit;
+		return true;
 	}
+	return false;
+}
+
+/*
+ * Starts executing "command" inside the directory "dir", directly if it does
+ * not need a shell. The utility is resolved only once across all its
+ * commands.
+ */
+utils::PipeDescriptor*
+utils::Spawn(std::string command, const char *dir)
+{
+	PipeDescriptor *pipe_descr = NULL;
+	SimpleCommand simple_command;
 
-	/* Retrieve exit status of the shell process. */
-	do {
-		pid = wait4(pipe_descr->pid, &pstat, 0, (struct rusage *)0);
-	} while (pid == -1 && errno == EINTR);
+	if (utils::ParseCommand(command, simple_command)) {
+		pipe_descr = utils::PSpawn
+			(utils::ResolveUtility(simple_command.argv.front()),
+			 simple_command, dir);
+	}
+	if (pipe_descr == NULL)
+		pipe_descr = utils::POpen(command.c_str(), dir);
+
+	return pipe_descr;
+}
+
+/*
+ * Executes the command passed as argument (in a shell, if required) and
+ * returns its output and exit status.
+ */
+std::pair<std::string, int>
+utils::Execute(std::string command)
+{
+	std::pair<std::string, int> result;
+	executor::Executor executor(1);
 
-	fclose(pipe);
-	exitstatus = (pid == -1) ? -1 : WEXITSTATUS(pstat);
-	DEBUGP("Command: %s, exit status: %d\n", command.c_str(), exitstatus);
+	executor.Submit(command, [&result](const ProbeResult& r) {
+		result = std::make_pair(std::string(r.output), r.exitstatus);
+	});
+	executor.Run();
 
-	return std::make_pair<std::string, int>
-		((std::string)usage_output, (int)exitstatus);
+	return result;
 }
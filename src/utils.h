@@ -29,53 +29,118 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <stdint.h>
+
+#include <string>
 #include <unordered_map>
 #include <vector>
 
-namespace utils {
-	/*
-	 * Option relation which maps option names to
-	 * a unique identifier in their description.
-	 */
-	struct OptRelation {
-		char type;            /* Option type: (s)short/(l)long. */
-		std::string value;    /* Name of the option. */
-		/* The keyword which should be looked up in usage
-		 * message (if) produced when using this options.
-		 */
-		std::string keyword;
-	};
+#include "mdoc.h"
+#include "option_catalog.h"
+#include "output_store.h"
 
+namespace utils {
 	/*
 	 * Read/Write file descriptors for a pipe.
 	 */
 	struct PipeDescriptor {
 		int readfd;
 		int writefd;
+		int errfd;  /* Read end of a pipe for stderr, -1 if merged. */
 		pid_t pid;  /* PID of the forked shell process. */
 	};
 
+	/* Outcome of running the utility with an option. */
+	struct ProbeResult {
+		outputstore::Output output;  /* stdout (and stderr, unless split). */
+		outputstore::Output error;   /* stderr, if split from stdout. */
+		int exitstatus;
+		bool timedout;       /* Killed on its deadline (see executor::Mode). */
+		bool truncated;      /* Killed past executor::max_{time,output}. */
+		long latency;        /* Milliseconds taken to respond. */
+		/* stdout and stderr of the repeated executions (see "repeat"). */
+		std::vector<outputstore::Output> repeated_output;
+		std::vector<outputstore::Output> repeated_error;
+	};
+
+	/*
+	 * A command which can be executed without a shell, i.e. its arguments
+	 * along with the redirections present in the command string.
+	 */
+	struct SimpleCommand {
+		std::vector<std::string> argv;
+		bool stderr_to_stdout;  /* "2>&1" */
+		bool stdin_null;        /* "</dev/null" */
+	};
+
 	/*
 	 * Temporary directory inside which the utility-specific commands
-	 * will be executed, and all the side effects (core dumps, executables)
-	 * that are created will be sandboxed in this directory.
+	 * will be executed (each in a directory of its own, see sandbox.h),
+	 * and all the side effects (core dumps, executables) that are created
+	 * will be sandboxed in this directory.
 	 */
 	extern const char *tmpdir;
 
+	/*
+	 * Environment of the shell process executing a command. It is kept
+	 * empty so that the results are independent of the user's environment.
+	 */
+	extern char *const probe_environ[];
+
+	/*
+	 * Whether the stderr of the utility is captured separately from its
+	 * stdout, producing precise assertions for both the streams.
+	 */
+	extern bool split_output;
+
+	/*
+	 * Number of times every command is executed (concurrently). The
+	 * output of a command which differs between the executions is
+	 * normalized, see normalize.h.
+	 */
+	extern int repeat;
+
+	/*
+	 * Resource limits (see setrlimit(2)) every command is executed with,
+	 * so that a misbehaving utility cannot exhaust the CPU, memory or the
+	 * space of "tmpdir" shared with the other commands. The CPU time is
+	 * in seconds and the sizes are in bytes, RLIM_INFINITY leaves the
+	 * resource unlimited.
+	 */
+	enum Limit { LIMIT_CPU, LIMIT_AS, LIMIT_FSIZE, LIMIT_CORE, LIMITS };
+	extern rlim_t probe_limits[LIMITS];
+
+	uint64_t Hash64(const char *, size_t, uint64_t = 0xcbf29ce484222325ULL);
+	uint64_t HashFile(std::string);
+	std::string ResolveUtility(std::string);
+	bool WriteFileAtomic(std::string, const std::string&);
+	bool WriteFileIfChanged(std::string, const std::string&);
 	std::string GenerateCommand(std::string, std::string);
 	std::pair<std::string, int> Execute(std::string);
-	PipeDescriptor* POpen(const char*);
+	bool ParseCommand(std::string, SimpleCommand&);
+	PipeDescriptor* POpen(const char*, const char*);
+	PipeDescriptor* PSpawn(std::string, const SimpleCommand&, const char*);
+	PipeDescriptor* Spawn(std::string, const char*);
+	bool BlockedOnRead(pid_t);
+	int ExitDescriptor(pid_t);
+	bool ParseLimit(const char *);
 
 	class OptDefinition {
 	public:
 		/* List of all the accepted options with unknown usage. */
 		std::vector<std::string> opt_list;
-		/* Map "option value" to "option definition". */
-		std::unordered_map<std::string, OptRelation> opt_map;
-		std::unordered_map<std::string, OptRelation>::iterator opt_map_iter;
+		/* Map "option value" to the kind of argument it accepts. */
+		std::unordered_map<std::string, mdoc::ArgKind> opt_args;
+		/*
+		 * Map "option value" to its group of mutually exclusive options
+		 * and its forms in the synopsis (see mdoc::Option).
+		 */
+		std::unordered_map<std::string,
+				   std::pair<uint16_t, uint16_t>> opt_synopsis;
 
-		void InsertOpts();
-		std::vector<OptRelation *> CheckOpts(std::string);
+		std::vector<optcatalog::Index> CheckOpts(std::string);
 	};
 }
 
@@ -0,0 +1,559 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#else
+#include <sys/event.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "fetch_groff.h"
+#include "logging.h"
+#include "read_annotations.h"
+#include "utils.h"
+#include "watch.h"
+
+/*
+ * Changes are collected for DEBOUNCE milliseconds after the first one, since
+ * an editor (or "make install") usually touches several files in a row.
+ */
+#define DEBOUNCE 100
+#define MAX_COMMAND 4096  /* Length of a command received on the socket. */
+
+typedef std::chrono::steady_clock Clock;
+
+std::string watch::socketpath = "watch.sock";
+
+/* A watched utility, along with the files its test depends on. */
+struct Utility {
+	std::string name;
+	std::vector<std::string> files;
+	uint64_t signature;  /* Of the state of "files". */
+	int testcases;
+};
+
+/* A watched directory, along with the utilities depending on its files. */
+struct Directory {
+	std::string path;
+	std::vector<size_t> utilities;
+#ifndef __linux__
+	/*
+	 * kqueue(2) reports the modifications of a file only to its own
+	 * descriptor, hence the files of interest are watched as well. A
+	 * replaced file is watched again once the directory changes.
+	 */
+	int fd;
+	std::unordered_map<std::string, int> files;  /* Name to descriptor. */
+#endif
+};
+
+static std::vector<Utility> utilities;
+static std::vector<Directory> directories;
+static std::unordered_map<std::string, size_t> directory_index;
+static int notify_fd = -1;  /* inotify(7) or kqueue(2) descriptor. */
+static int listen_fd = -1;
+#ifdef __linux__
+static std::unordered_map<int, size_t> watch_descriptors;
+#endif
+static volatile sig_atomic_t stop;
+
+static void
+StopHandler(int)
+{
+	stop = 1;
+}
+
+/* Hashes the identity and the modification time of the file at "path". */
+static uint64_t
+HashStat(std::string path, uint64_t hash)
+{
+	struct stat sb;
+	int64_t stamp[3] = { 0, 0, 0 };
+
+	if (stat(path.c_str(), &sb) == 0) {
+		stamp[0] = sb.st_ino;
+		stamp[1] = (int64_t)sb.st_mtim.tv_sec * 1000000000
+			 + sb.st_mtim.tv_nsec;
+		stamp[2] = sb.st_size;
+	}
+	hash = utils::Hash64(path.c_str(), path.size() + 1, hash);
+	return utils::Hash64((const char *)stamp, sizeof(stamp), hash);
+}
+
+static uint64_t
+Signature(const Utility& utility)
+{
+	uint64_t hash = utils::Hash64(NULL, 0);
+
+	for (const auto &file : utility.files)
+		hash = HashStat(file, hash);
+	return hash;
+}
+
+#ifndef __linux__
+static void
+Register(int fd, size_t index, u_int fflags)
+{
+	struct kevent event;
+
+	EV_SET(&event, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, fflags, 0,
+	       (void *)(uintptr_t)index);
+	if (kevent(notify_fd, &event, 1, NULL, 0, NULL) < 0)
+		logging::LogPerror("kevent()");
+}
+
+/* Watches the files of interest in a directory which are not yet watched. */
+static void
+WatchFiles(size_t index)
+{
+	Directory& dir = directories[index];
+	std::string path;
+
+	for (auto &it : dir.files) {
+		if (it.second >= 0)
+			continue;
+		path = dir.path + "/" + it.first;
+		it.second = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (it.second >= 0) {
+			Register(it.second, index, NOTE_WRITE | NOTE_EXTEND |
+				 NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME);
+		}
+	}
+}
+#endif
+
+/* Watches the directory of "path" for changes affecting utility "index". */
+static void
+AddFile(std::string path, size_t index)
+{
+	size_t slash = path.find_last_of('/');
+	std::string dirpath = ".";
+	std::string name = path.substr(slash + 1);
+	size_t dir_index;
+	int wd;
+
+	if (slash != std::string::npos)
+		dirpath = path.substr(0, slash);
+
+	auto it = directory_index.find(dirpath);
+	if (it == directory_index.end()) {
+		dir_index = directories.size();
+		directories.push_back(Directory());
+		directories.back().path = dirpath;
+		directory_index[dirpath] = dir_index;
+#ifdef __linux__
+		wd = inotify_add_watch(notify_fd, dirpath.c_str(),
+				       IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY |
+				       IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+				       IN_MOVED_TO | IN_ONLYDIR);
+		if (wd >= 0)
+			watch_descriptors[wd] = dir_index;
+#else
+		wd = open(dirpath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		directories.back().fd = wd;
+		if (wd >= 0) {
+			Register(wd, dir_index,
+				 NOTE_WRITE | NOTE_DELETE | NOTE_RENAME);
+		}
+#endif
+		if (wd < 0) {
+			std::cerr << "Unable to watch directory: "
+				  << dirpath << "\n";
+		}
+	} else {
+		dir_index = it->second;
+	}
+
+	Directory& dir = directories[dir_index];
+	if (std::find(dir.utilities.begin(), dir.utilities.end(), index)
+	    == dir.utilities.end())
+		dir.utilities.push_back(index);
+#ifndef __linux__
+	if (dir.files.find(name) == dir.files.end()) {
+		dir.files[name] = -1;
+		WatchFiles(dir_index);
+	}
+#endif
+}
+
+/* Collects the (indices of the) directories in which a change was reported. */
+static void
+ReadEvents(std::unordered_set<size_t>& changed)
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[16384];
+	const struct inotify_event *event;
+	ssize_t len;
+
+	while ((len = read(notify_fd, buffer, sizeof(buffer))) > 0) {
+		for (char *p = buffer; p < buffer + len;
+		     p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p;
+			if (event->mask & IN_Q_OVERFLOW) {
+				/* Events were lost, look everywhere. */
+				for (size_t i = 0; i < directories.size(); i++)
+					changed.insert(i);
+				continue;
+			}
+			auto it = watch_descriptors.find(event->wd);
+			if (it != watch_descriptors.end())
+				changed.insert(it->second);
+		}
+	}
+#else
+	struct kevent events[64];
+	struct timespec zero = { 0, 0 };
+	int nevents;
+
+	while ((nevents = kevent(notify_fd, NULL, 0, events, 64, &zero)) > 0) {
+		for (int i = 0; i < nevents; i++) {
+			size_t index = (uintptr_t)events[i].udata;
+			Directory& dir = directories[index];
+
+			changed.insert(index);
+			if ((int)events[i].ident == dir.fd ||
+			    !(events[i].fflags & (NOTE_DELETE | NOTE_RENAME)))
+				continue;
+			/* The file is gone, watch its replacement instead. */
+			for (auto &it : dir.files) {
+				if (it.second == (int)events[i].ident) {
+					close(it.second);
+					it.second = -1;
+				}
+			}
+		}
+		if (nevents < 64)
+			break;
+	}
+	for (const auto &index : changed)
+		WatchFiles(index);
+#endif
+}
+
+/* Returns the utilities whose files changed, among those of "candidates". */
+static std::vector<size_t>
+Changed(const std::vector<size_t>& candidates)
+{
+	std::vector<size_t> changed;
+
+	for (const auto &index : candidates) {
+		if (Signature(utilities[index]) != utilities[index].signature)
+			changed.push_back(index);
+	}
+
+	return changed;
+}
+
+/*
+ * Regenerates the tests of the given utilities, returns the regenerated tests
+ * as "<utility> <testcases>" lines.
+ */
+static std::string
+Regenerate(std::vector<size_t> indices, watch::Generator& generate)
+{
+	std::vector<std::string> names;
+	std::map<std::string, int> testcases;
+	std::string reply;
+
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()),
+		      indices.end());
+	if (indices.empty())
+		return reply;
+
+	/*
+	 * Recorded beforehand, so that a change made in the meantime is
+	 * noticed.
+	 */
+	for (const auto &index : indices) {
+		utilities[index].signature = Signature(utilities[index]);
+		names.push_back(utilities[index].name);
+	}
+
+	testcases = generate(names);
+	for (const auto &index : indices) {
+		Utility& utility = utilities[index];
+		utility.testcases = testcases[utility.name];
+		reply += utility.name + " "
+		       + std::to_string(utility.testcases) + "\n";
+	}
+
+	return reply;
+}
+
+/*
+ * Creates the socket, unless an instance of the tool is already listening on
+ * it. A socket left behind by an instance which is no longer running is
+ * replaced. Called early on, so that a second instance bails out before
+ * touching anything.
+ */
+bool
+watch::Listen()
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketpath.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "Socket path is too long: " << socketpath << "\n";
+		return false;
+	}
+	strcpy(addr.sun_path, socketpath.c_str());
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		logging::LogPerror("socket()");
+		return false;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		std::cerr << "Already being watched, see: " << socketpath << "\n";
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	unlink(socketpath.c_str());
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		logging::LogPerror("socket()");
+		return false;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0) {
+		logging::LogPerror("bind()");
+		close(fd);
+		return false;
+	}
+
+	listen_fd = fd;
+	return true;
+}
+
+/* Executes a command received on the socket, returns the reply. */
+static std::string
+Execute(std::string line, watch::Generator& generate,
+	std::unordered_set<size_t>& changed)
+{
+	std::istringstream words(line);
+	std::vector<size_t> indices;
+	std::string command;
+	std::string name;
+	std::string reply;
+
+	words >> command;
+	if (command == "status") {
+		for (const auto &utility : utilities) {
+			reply += utility.name + " "
+			       + std::to_string(utility.testcases) + "\n";
+		}
+	} else if (command == "sync") {
+		/* Pending changes are covered as well. */
+		ReadEvents(changed);
+		changed.clear();
+		for (size_t i = 0; i < utilities.size(); i++)
+			indices.push_back(i);
+		reply = Regenerate(Changed(indices), generate);
+	} else if (command == "regenerate") {
+		while (words >> name) {
+			auto it = std::find_if(utilities.begin(),
+					       utilities.end(),
+					       [&name](const Utility& utility) {
+						       return utility.name == name;
+					       });
+			if (it == utilities.end())
+				reply += name + ": unknown utility\n";
+			else
+				indices.push_back(it - utilities.begin());
+		}
+		if (reply.empty() && indices.empty()) {
+			for (size_t i = 0; i < utilities.size(); i++)
+				indices.push_back(i);
+		}
+		reply += Regenerate(indices, generate);
+	} else if (command == "quit") {
+		stop = 1;
+	} else {
+		reply = "unknown command: " + command + "\n";
+	}
+
+	return reply;
+}
+
+/* Serves a single command of a client connected to the socket. */
+static void
+Serve(watch::Generator& generate, std::unordered_set<size_t>& changed)
+{
+	struct timeval timeout = { 1, 0 };
+	std::string line;
+	std::string reply;
+	char buffer[512];
+	ssize_t len = 0;
+	int fd;
+
+	if ((fd = accept(listen_fd, NULL, NULL)) < 0)
+		return;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	/* A client is given a second to send its command. */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	while (line.find('\n') == std::string::npos &&
+	       line.size() < MAX_COMMAND &&
+	       (len = read(fd, buffer, sizeof(buffer))) > 0)
+		line.append(buffer, len);
+	line = line.substr(0, line.find('\n'));
+
+	reply = Execute(line, generate, changed);
+	for (size_t sent = 0; sent < reply.size(); sent += len) {
+		if ((len = send(fd, reply.data() + sent, reply.size() - sent,
+				MSG_NOSIGNAL)) <= 0)
+			break;
+	}
+	close(fd);
+}
+
+/*
+ * Generates the tests of the given utilities, and then regenerates them as
+ * the files they depend on change, until interrupted (or asked to quit).
+ * The socket must have been created via Listen().
+ */
+int
+watch::Run(const std::vector<std::string>& selected, Generator generate)
+{
+	struct sigaction action;
+	struct pollfd pollfds[2];
+	std::unordered_set<size_t> changed;
+	std::vector<size_t> candidates;
+	std::string binary;
+	Clock::time_point deadline;
+	bool pending = false;  /* Whether changes are being collected. */
+	int timeout;
+
+#ifdef __linux__
+	notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	notify_fd = kqueue();
+#endif
+	if (notify_fd < 0) {
+		logging::LogPerror("Unable to watch for changes");
+		close(listen_fd);
+		unlink(socketpath.c_str());
+		return EXIT_FAILURE;
+	}
+
+	for (const auto &name : selected) {
+		Utility utility;
+
+		utility.name = name;
+		utility.files.push_back(groff::groff_map.at(name));
+		if (!(binary = utils::ResolveUtility(name)).empty())
+			utility.files.push_back(binary);
+		utility.files.push_back(annotations::AnnotationFile(name));
+		utility.testcases = 0;
+		utilities.push_back(utility);
+		for (const auto &file : utility.files)
+			AddFile(file, utilities.size() - 1);
+		candidates.push_back(utilities.size() - 1);
+	}
+	Regenerate(candidates, generate);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = StopHandler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	std::cout << "\nWatching " << utilities.size() << " utilities, "
+		     "listening on " << socketpath << std::endl;
+
+	pollfds[0].fd = notify_fd;
+	pollfds[0].events = POLLIN;
+	pollfds[1].fd = listen_fd;
+	pollfds[1].events = POLLIN;
+	while (!stop) {
+		timeout = -1;
+		if (pending) {
+			timeout = std::chrono::duration_cast
+				<std::chrono::milliseconds>
+				(deadline - Clock::now()).count();
+			timeout = std::max(timeout, 0);
+		}
+		if (poll(pollfds, 2, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			logging::LogPerror("poll()");
+			break;
+		}
+
+		if (pollfds[0].revents & POLLIN) {
+			ReadEvents(changed);
+			if (!pending && !changed.empty()) {
+				pending = true;
+				deadline = Clock::now()
+					 + std::chrono::milliseconds(DEBOUNCE);
+			}
+		}
+		if (pending && Clock::now() >= deadline) {
+			candidates.clear();
+			for (const auto &index : changed) {
+				const Directory& dir = directories[index];
+				candidates.insert(candidates.end(),
+						  dir.utilities.begin(),
+						  dir.utilities.end());
+			}
+			changed.clear();
+			pending = false;
+			std::cout << Regenerate(Changed(candidates), generate)
+				  << std::flush;
+		}
+		if (pollfds[1].revents & POLLIN) {
+			Serve(generate, changed);
+			pending = !changed.empty();
+		}
+	}
+
+	close(listen_fd);
+	unlink(socketpath.c_str());
+	close(notify_fd);
+	return EXIT_SUCCESS;
+}
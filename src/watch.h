@@ -0,0 +1,76 @@
+/*-
+ * Copyright 2017-2018 Shivansh Rai
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * With "--watch", the tool keeps running once the tests are generated, and
+ * regenerates the test of a utility as soon as a file it depends on changes -
+ *
+ * 	<srcdir>/<dir>/<utility>.<section>  Man page.
+ * 	<path>/<utility>                    Installed executable.
+ * 	annotations/<utility>_test.annot    Annotations.
+ *
+ * The directories holding these files are watched (via inotify(7) on Linux
+ * and kqueue(2) elsewhere), so that files replaced by editors are noticed as
+ * well. In the meantime, the discovered utilities, their options and the
+ * results of the executed commands are kept in memory.
+ *
+ * The tool is controlled via a Unix domain socket, which accepts a single
+ * command (line) per connection -
+ *
+ * 	status                    Lists the utilities and their testcase count.
+ * 	sync                      Regenerates the tests of the changed utilities
+ * 	                          right away, even if a change went unnoticed.
+ * 	regenerate [utility ...]  Regenerates the given (by default, all) tests.
+ * 	quit                      Stops watching.
+ *
+ * e.g. "echo sync | nc -U watch.sock". The tests regenerated by a command
+ * are replied as "<utility> <testcases>" lines.
+ */
+namespace watch {
+	/*
+	 * Generates the tests of the given utilities, returning the number of
+	 * testcases of each.
+	 */
+	typedef std::function<std::map<std::string, int>
+			      (const std::vector<std::string>&)> Generator;
+
+	extern std::string socketpath;
+
+	bool Listen();
+	int Run(const std::vector<std::string>&, Generator);
+}
+
+#endif  /* _WATCH_H_ */